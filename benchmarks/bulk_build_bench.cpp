@@ -0,0 +1,65 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "order_statistic_tree.h"
+using namespace std;
+
+const int N = 1000000;
+
+long long ext_rand() { return (long long)rand() * RAND_MAX + rand(); }
+
+template<class F>
+void measure(string name, F f) {
+    auto start = chrono::steady_clock::now();
+    f();
+    auto finish = chrono::steady_clock::now();
+    cout << name << ": " << chrono::duration_cast<chrono::milliseconds>(finish - start).count() << " ms\n";
+}
+
+int main() {
+    srand(1);
+    vector<int> keys(N);
+    for (auto& c : keys) c = ext_rand() % (N * 10);
+    vector<int> sorted = keys;
+    sort(sorted.begin(), sorted.end());
+    sorted.erase(unique(sorted.begin(), sorted.end()), sorted.end());
+
+    for (int it = 0; it < 2; it++) {
+        size_t sz = 0;
+        const vector<int>& src = it ? keys : sorted;
+        string kind = it ? "unsorted" : "sorted";
+
+        measure(kind + " range, repeated insert", [&]() {
+            order_statistic_tree<int> st;
+            for (auto c : src) st.insert(c);
+            sz += st.size();
+        });
+
+        measure(kind + " range, bulk build", [&]() {
+            order_statistic_tree<int> st(src.begin(), src.end());
+            sz += st.size();
+        });
+
+        measure(kind + " range, parallel bulk build", [&]() {
+            order_statistic_tree<int> st(src.begin(), src.end(), order_statistic_parallel_policy());
+            sz += st.size();
+        });
+
+        if (sz != 3 * sorted.size()) cout << "size mismatch\n";
+    }
+
+    order_statistic_tree<int> st1(keys.begin(), keys.begin() + N / 2), st2(keys.begin() + N / 2, keys.end());
+    order_statistic_tree<int> st3 = st1, st4 = st2;
+    measure("union", [&]() {
+        st1.union_with(std::move(st2));
+    });
+
+    measure("parallel union", [&]() {
+        st3.union_with(std::move(st4), order_statistic_parallel_policy());
+    });
+
+    if (!(st1 == st3)) cout << "union mismatch\n";
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include "order_statistic_tree.h"
+using namespace std;
+
+const int N = 1000000, Q = 1000000;
+
+long long ext_rand() { return (long long)rand() * RAND_MAX + rand(); }
+
+template<class F>
+void measure(string name, F f) {
+    auto start = chrono::steady_clock::now();
+    f();
+    auto finish = chrono::steady_clock::now();
+    cout << name << ": " << chrono::duration_cast<chrono::milliseconds>(finish - start).count() << " ms\n";
+}
+
+int main() {
+    srand(1);
+    vector<int> keys(N), queries(Q), ranks(Q);
+    for (auto& c : keys) c = ext_rand() % (N * 10);
+    for (auto& c : queries) c = ext_rand() % (N * 10);
+
+    order_statistic_tree<int> st(keys.begin(), keys.end());
+    for (auto& c : ranks) c = ext_rand() % st.size();
+
+    long long found = 0;
+    vector<char> res(Q);
+    measure("contains", [&]() {
+        for (auto c : queries) found += st.contains(c);
+    });
+    measure("contains_many", [&]() {
+        st.contains_many(queries.begin(), queries.end(), res.begin());
+    });
+
+    vector<order_statistic_tree<int>::const_iterator> its(Q);
+    measure("statistic", [&]() {
+        for (int i = 0; i < Q; i++) its[i] = st.statistic(ranks[i]);
+    });
+    measure("statistic_many", [&]() {
+        st.statistic_many(ranks.begin(), ranks.end(), its.begin());
+    });
+
+    measure("lower_bound", [&]() {
+        for (int i = 0; i < Q; i++) its[i] = st.lower_bound(queries[i]);
+    });
+    measure("lower_bound_many", [&]() {
+        st.lower_bound_many(queries.begin(), queries.end(), its.begin());
+    });
+
+    frozen_order_statistic_tree<int> frozen = st.freeze();
+    vector<frozen_order_statistic_tree<int>::const_iterator> frozen_its(Q);
+    measure("frozen contains", [&]() {
+        for (auto c : queries) found += frozen.contains(c);
+    });
+    measure("frozen statistic", [&]() {
+        for (int i = 0; i < Q; i++) frozen_its[i] = frozen.statistic(ranks[i]);
+    });
+    measure("frozen lower_bound", [&]() {
+        for (int i = 0; i < Q; i++) frozen_its[i] = frozen.lower_bound(queries[i]);
+    });
+
+    sort(queries.begin(), queries.end());
+    measure("sorted lower_bound", [&]() {
+        for (int i = 0; i < Q; i++) its[i] = st.lower_bound(queries[i]);
+    });
+    measure("lower_bound_sorted", [&]() {
+        st.lower_bound_sorted(queries.begin(), queries.end(), its.begin());
+    });
+
+    order_statistic_tree<int> st2 = st, st3 = st;
+    measure("sorted insert", [&]() {
+        for (auto c : queries) st2.insert(c);
+    });
+    measure("insert_sorted", [&]() {
+        st3.insert_sorted(queries.begin(), queries.end());
+    });
+    if (!(st2 == st3)) cout << "insert mismatch\n";
+
+    cout << found << '\n';
+    return 0;
+}
@@ -0,0 +1,50 @@
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include "order_statistic_tree.h"
+using namespace std;
+
+const int N = 1000000;
+
+long long ext_rand() { return (long long)rand() * RAND_MAX + rand(); }
+
+template<class F>
+void measure(string name, F f) {
+    auto start = chrono::steady_clock::now();
+    f();
+    auto finish = chrono::steady_clock::now();
+    cout << name << ": " << chrono::duration_cast<chrono::milliseconds>(finish - start).count() << " ms\n";
+}
+
+int main() {
+    srand(1);
+    vector<int> keys(N);
+    for (auto& c : keys) c = ext_rand() % (N * 10);
+
+    order_statistic_tree<int> st;
+    measure("random insert", [&]() {
+        for (auto c : keys) st.insert(c);
+    });
+
+    measure("random erase", [&]() {
+        for (int i = 0; i < N / 2; i++) st.erase(keys[i]);
+    });
+
+    measure("insert and erase churn", [&]() {
+        for (int i = 0; i < N; i++) {
+            st.insert(keys[i] + 1);
+            st.erase(keys[(i + N / 2) % N]);
+        }
+    });
+
+    st.clear();
+    measure("sorted insert", [&]() {
+        for (int i = 0; i < N; i++) st.insert(i);
+    });
+
+    measure("sorted erase", [&]() {
+        for (int i = 0; i < N; i++) st.erase(i);
+    });
+
+    return 0;
+}
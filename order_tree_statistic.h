@@ -2,31 +2,181 @@
 #include <random>
 #include <functional>
 #include <algorithm>
+#include <memory>
+#include <vector>
+#include <type_traits>
+#include <cstdint>
+#include <limits>
+#include <iterator>
+#include <utility>
+#include <tuple>
+#include <string>
+#include <stdexcept>
+#include <initializer_list>
+#include <future>
+#include <thread>
+#include <atomic>
+
+/*
+    Fork-join execution of bulk operations of order_statistic_tree.
+    Up to threads tasks run concurrently, subproblems with less than grain keys are solved sequentially.
+*/
+struct order_statistic_parallel_policy {
+    unsigned threads = std::max(1u, std::thread::hardware_concurrency());
+    size_t grain = 1 << 16;
+};
+
+/*
+    Augmentation policies of order_statistic_tree. A policy defines value_type, identity(), value(key, cnt)
+    for a key repeated cnt times and an associative combine(a, b) where a comes from smaller keys.
+    The aggregate of every subtree is kept in its root and recomputed whenever the subtree changes.
+    Trees with lazy_shift also need shift(agg, d, cnt), the aggregate of cnt keys after d is added to each of them.
+*/
+struct order_statistic_no_augment {};
+
+template<class T>
+struct order_statistic_sum {
+    using value_type = T;
+
+    static T identity() {
+        return T();
+    }
+
+    template<class K>
+    static T value(const K& key, int cnt) {
+        return T(key) * cnt;
+    }
+
+    static T combine(const T& a, const T& b) {
+        return a + b;
+    }
+
+    template<class K>
+    static T shift(const T& agg, const K& d, size_t cnt) {
+        return agg + T(d) * T(cnt);
+    }
+};
+
+template<class T>
+struct order_statistic_min {
+    using value_type = T;
+
+    static T identity() {
+        return std::numeric_limits<T>::max();
+    }
+
+    template<class K>
+    static T value(const K& key, int) {
+        return T(key);
+    }
+
+    static T combine(const T& a, const T& b) {
+        return std::min(a, b);
+    }
+
+    template<class K>
+    static T shift(const T& agg, const K& d, size_t) {
+        return agg + T(d);
+    }
+};
+
+template<class T>
+struct order_statistic_max {
+    using value_type = T;
+
+    static T identity() {
+        return std::numeric_limits<T>::lowest();
+    }
+
+    template<class K>
+    static T value(const K& key, int) {
+        return T(key);
+    }
+
+    static T combine(const T& a, const T& b) {
+        return std::max(a, b);
+    }
+
+    template<class K>
+    static T shift(const T& agg, const K& d, size_t) {
+        return agg + T(d);
+    }
+};
 
-template<typename _key, class compare = std::less<_key>>
+template<typename _key, typename _value, class compare, class Allocator>
+class order_statistic_map;
+
+template<typename _value, class Allocator>
+class order_statistic_sequence;
+
+template<typename _key, class compare, class Allocator>
+class frozen_order_statistic_tree;
+
+/*
+    With lazy_shift = true shift_range adds a value to all keys of a range in O(log n). The shift is kept
+    as a pending tag in the root of the shifted subtree and pushed down by the walks passing through it,
+    so _key must support + and += with _key() being zero.
+*/
+template<typename _key, class compare = std::less<_key>, class Allocator = std::allocator<_key>, bool multi = false,
+         class augment = order_statistic_no_augment, bool lazy_shift = false>
 class order_statistic_tree {
 private:
-    class tree_node {
+    template<typename, typename, class, class>
+    friend class order_statistic_map;
+
+    template<typename, class>
+    friend class order_statistic_sequence;
+
+    static constexpr bool augmented = !std::is_same<augment, order_statistic_no_augment>::value;
+
+    // the aggregate of the subtree, takes no space in nodes of trees without augmentation
+    template<class A, bool enabled>
+    struct aggregate_holder {};
+
+    template<class A>
+    struct aggregate_holder<A, true> {
+        typename A::value_type agg;
+    };
+
+    using aggregate_base = aggregate_holder<augment, augmented>;
+
+    // the shift which is not yet applied to the keys of the subtrees of children
+    template<class K, bool enabled>
+    struct shift_holder {};
+
+    template<class K>
+    struct shift_holder<K, true> {
+        K add = K();
+    };
+
+    using shift_base = shift_holder<_key, lazy_shift>;
+
+    class tree_node : public aggregate_base, public shift_base {
     public:
         _key key;
         int prior, size = 1;
+        // number of copies of the key, greater than 1 only in multiset mode
+        int cnt = 1;
         tree_node* l = nullptr, * r = nullptr, * par = nullptr;
 
-        tree_node(_key k) {
-            key = k;
-            prior = rand();
-        }
-
-        ~tree_node() {
-            if (l) delete l;
-            if (r) delete r;
-        }
+        // the priority is assigned by the code which links the node into a tree
+        template<class... Args>
+        explicit tree_node(std::in_place_t, Args&&... args) : key(std::forward<Args>(args)...) {}
 
         tree_node() {}
 
+        void update_aggregate() {
+            if constexpr (augmented) {
+                this->agg = augment::value(key, cnt);
+                if (l) this->agg = augment::combine(l->agg, this->agg);
+                if (r) this->agg = augment::combine(this->agg, r->agg);
+            }
+        }
+
         // fixed sizes of current vertex and parents of adjacent vertices
         void update_node() {
-            size = 1;
+            update_aggregate();
+            size = cnt;
 
             par = nullptr;
             if (l) {
@@ -42,102 +192,414 @@ private:
 
     using node_pair = std::pair<tree_node*, tree_node*>;
 
+    /*
+        Scratch list of nodes. Lists of the calling thread take the allocator of the tree, so a tree over
+        a std::pmr resource keeps off the heap, lists of tasks forked by parallel operations are default constructed.
+    */
+    using node_list = std::vector<tree_node*, typename std::allocator_traits<Allocator>::template rebind_alloc<tree_node*>>;
+
+    /*
+        Slab allocator for tree nodes. Nodes are carved from slabs of geometrically growing size,
+        erased nodes are kept in a free list for reuse and all slabs are given back at once by release().
+        A pool is shared by a tree and the trees split off it until they are joined elsewhere, and by node handles.
+    */
+    class node_pool {
+    private:
+        using node_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<tree_node>;
+        using traits = std::allocator_traits<node_allocator>;
+        using slab = std::pair<tree_node*, size_t>;
+
+        static constexpr size_t min_slab = 16, max_slab = 1 << 16;
+
+        // storage of a released node is reused as a link of the free list
+        struct free_slot {
+            free_slot* next;
+        };
+
+        node_allocator alloc;
+        std::vector<slab, typename traits::template rebind_alloc<slab>> slabs;
+        free_slot* free_list = nullptr, * free_tail = nullptr;
+        size_t slab_used = 0;
+        // nodes given back by node handles, possibly from other threads, they join the free list when it runs out
+        std::atomic<free_slot*> remote_list{ nullptr };
+
+        void take_remote() {
+            free_slot* taken = remote_list.exchange(nullptr, std::memory_order_acquire);
+            if (!taken) return;
+
+            free_slot* tail = taken;
+            while (tail->next) tail = tail->next;
+            tail->next = free_list;
+            if (!free_list) free_tail = tail;
+            free_list = taken;
+        }
+
+        tree_node* allocate() {
+            if (!free_list) take_remote();
+            if (free_list) {
+                free_slot* slot = free_list;
+                free_list = slot->next;
+                if (!free_list) free_tail = nullptr;
+                slot->~free_slot();
+                return reinterpret_cast<tree_node*>(slot);
+            }
+
+            if (slabs.empty() || slab_used == slabs.back().second) {
+                size_t cnt = slabs.empty() ? min_slab : std::min(slabs.back().second * 2, max_slab);
+                slabs.emplace_back(traits::allocate(alloc, cnt), cnt);
+                slab_used = 0;
+            }
+
+            return slabs.back().first + slab_used++;
+        }
+
+    public:
+        explicit node_pool(const Allocator& a) : alloc(a), slabs(a) {}
+        node_pool(const node_pool&) = delete;
+        node_pool& operator=(const node_pool&) = delete;
+
+        ~node_pool() {
+            release();
+        }
+
+        template<class... Args>
+        tree_node* create(Args&&... args) {
+            tree_node* v = allocate();
+            traits::construct(alloc, v, std::in_place, std::forward<Args>(args)...);
+            return v;
+        }
+
+        // returns storage for n nodes from a new slab, the nodes must be constructed by construct()
+        tree_node* allocate_block(size_t n) {
+            slabs.emplace_back(traits::allocate(alloc, n), n);
+            slab_used = n;
+            return slabs.back().first;
+        }
+
+        // may be called concurrently for different nodes
+        template<class... Args>
+        void construct(tree_node* v, Args&&... args) {
+            traits::construct(alloc, v, std::in_place, std::forward<Args>(args)...);
+        }
+
+        // allocates a node outside of slabs, so it survives release()
+        tree_node* create_sentinel() {
+            tree_node* v = traits::allocate(alloc, 1);
+            traits::construct(alloc, v);
+            return v;
+        }
+
+        void destroy_sentinel(tree_node* v) {
+            traits::destroy(alloc, v);
+            traits::deallocate(alloc, v, 1);
+        }
+
+        // destroys the node and puts its storage to the free list
+        void destroy(tree_node* v) {
+            traits::destroy(alloc, v);
+            free_list = ::new (static_cast<void*>(v)) free_slot{ free_list };
+            if (!free_list->next) free_tail = free_list;
+        }
+
+        // destroys the node and gives its storage back, safe to call while another thread uses the pool
+        void destroy_remote(tree_node* v) {
+            traits::destroy(alloc, v);
+            free_slot* slot = ::new (static_cast<void*>(v)) free_slot{ remote_list.load(std::memory_order_relaxed) };
+            while (!remote_list.compare_exchange_weak(slot->next, slot, std::memory_order_release, std::memory_order_relaxed)) {}
+        }
+
+        // makes sure that the next n nodes are taken from a single slab without further allocations
+        void reserve(size_t n) {
+            size_t left = slabs.empty() ? 0 : slabs.back().second - slab_used;
+            if (left >= n) return;
+
+            slabs.emplace_back(traits::allocate(alloc, n), n);
+            slab_used = 0;
+        }
+
+        // gives all slabs back to the allocator, nodes must be destroyed by the caller beforehand
+        void release() {
+            for (auto& [ptr, cnt] : slabs) traits::deallocate(alloc, ptr, cnt);
+            slabs.clear();
+            free_list = free_tail = nullptr;
+            remote_list.store(nullptr, std::memory_order_relaxed);
+            slab_used = 0;
+        }
+
+        // takes over slabs and free nodes of other, allocators of both pools must compare equal
+        void absorb(node_pool& other) {
+            if (slabs.empty()) {
+                slab_used = other.slab_used;
+                slabs.insert(slabs.end(), other.slabs.begin(), other.slabs.end());
+            } else {
+                // the current slab stays last, the rest of the last slab of other is not used anymore
+                slabs.insert(slabs.end() - 1, other.slabs.begin(), other.slabs.end());
+            }
+
+            other.take_remote();
+            if (other.free_list) {
+                other.free_tail->next = free_list;
+                if (!free_list) free_tail = other.free_tail;
+                free_list = other.free_list;
+            }
+
+            other.slabs.clear();
+            other.free_list = other.free_tail = nullptr;
+            other.slab_used = 0;
+        }
+
+        Allocator get_allocator() const {
+            return Allocator(alloc);
+        }
+    };
+
     // -------------------------- tree_node helper functions -----------------
 
     static size_t size(tree_node* v) {
         return v ? v->size : 0;
     }
 
-    // fixes priorities if priority of v->l is larger than priority of v
-    tree_node* rightRotate(tree_node* v) {
-        tree_node* x = v->l;
-
-        v->l = x->r;
-        x->r = v;
-        v->update_node();
-        x->update_node();
+    // adds d to all keys of the subtree, the children get it as a pending tag
+    static void shift_subtree(tree_node* v, const _key& d) {
+        if constexpr (lazy_shift) {
+            v->key += d;
+            v->add += d;
+            if constexpr (augmented) v->agg = augment::shift(v->agg, d, v->size);
+        }
+    }
 
-        return x;
+    // applies the pending shift of v to its children, must be called before walking down from v
+    static void push(tree_node* v) {
+        if constexpr (lazy_shift) {
+            if (v->add == _key()) return;
+            if (v->l) shift_subtree(v->l, v->add);
+            if (v->r) shift_subtree(v->r, v->add);
+            v->add = _key();
+        }
     }
 
-    // fixes priorities if priority of v->r is larger than priority of v
-    tree_node* leftRotate(tree_node* v) {
-        tree_node* x = v->r;
+    /*
+        Stack of nodes for iterative tree walks. The first stack_capacity entries live inside the object,
+        deeper paths spill to the heap, so the walks never depend on the depth of the tree.
+    */
+    class node_stack {
+    private:
+        static constexpr size_t stack_capacity = 128;
 
-        v->r = x->l;
-        x->l = v;
-        v->update_node();
-        x->update_node();
+        tree_node* fixed[stack_capacity];
+        std::vector<tree_node*> spill;
+        size_t cnt = 0;
+    public:
+        [[nodiscard]] bool empty() const {
+            return cnt == 0;
+        }
 
-        return x;
+        void push(tree_node* v) {
+            if (cnt < stack_capacity) fixed[cnt] = v;
+            else spill.push_back(v);
+            ++cnt;
+        }
+
+        tree_node* pop() {
+            --cnt;
+            if (cnt < stack_capacity) return fixed[cnt];
+            tree_node* v = spill.back();
+            spill.pop_back();
+            return v;
+        }
+
+        // updates all nodes on the stack from the deepest one to the topmost one
+        void fix() {
+            while (!empty()) pop()->update_node();
+        }
+    };
+
+    // splits the tree into nodes satisfying goes_left and the rest, goes_left must be monotone in key order
+    template<class Pred>
+    static node_pair split_by(tree_node* v, Pred goes_left) {
+        node_pair res = { nullptr, nullptr };
+        tree_node** l = &res.first, ** r = &res.second;
+
+        node_stack path;
+        while (v) {
+            push(v);
+            path.push(v);
+            if (goes_left(v)) {
+                *l = v;
+                l = &v->r;
+                v = v->r;
+            } else {
+                *r = v;
+                r = &v->l;
+                v = v->l;
+            }
+        }
+        *l = *r = nullptr;
+        path.fix();
+
+        return res;
     }
 
     // splits the tree by given key with less comparator
-    node_pair split(tree_node* v, _key value) {
-        if (!v) return { nullptr, nullptr };
+    template<class K>
+    static node_pair split(tree_node* v, const K& value) {
+        return split_by(v, [&](tree_node* u) { return compare()(u->key, value); });
+    }
 
-        if (compare()(v->key, value)) {
-            node_pair res = split(v->r, value);
-            v->r = res.first;
-            v->update_node();
-            return { v, res.second };
-        } else {
-            node_pair res = split(v->l, value);
-            v->l = res.second;
-            v->update_node();
-            return { res.first, v };
+    // splits the tree by given key with less or equal comparator
+    template<class K>
+    static node_pair spliteq(tree_node* v, const K& value) {
+        return split_by(v, [&](tree_node* u) { return !compare()(value, u->key); });
+    }
+
+    // merges two trees such that all keys in l are smaller than keys in r
+    static tree_node* merge(tree_node* l, tree_node* r) {
+        tree_node* res = nullptr;
+        tree_node** hook = &res;
+
+        node_stack path;
+        while (l && r) {
+            if (l->prior > r->prior) {
+                push(l);
+                path.push(l);
+                *hook = l;
+                hook = &l->r;
+                l = l->r;
+            } else {
+                push(r);
+                path.push(r);
+                *hook = r;
+                hook = &r->l;
+                r = r->l;
+            }
         }
+        *hook = l ? l : r;
+        path.fix();
+
+        if (res) res->par = nullptr;
+        return res;
     }
 
-    // splits the tree by given key with less or equal comparator
-    node_pair spliteq(tree_node* v, _key value) {
-        if (!v) return { nullptr, nullptr };
-
-        if (!compare()(value, v->key)) {
-            node_pair res = spliteq(v->r, value);
-            v->r = res.first;
-            v->update_node();
-            return { v, res.second };
-        } else {
-            node_pair res = spliteq(v->l, value);
-            v->l = res.second;
-            v->update_node();
-            return { res.first, v };
+    /*
+        Inserts value with a single descent, the node is created by make() only if value is not contained yet.
+        Returns the node holding value and whenever it was created.
+    */
+    template<class K, class Make>
+    std::pair<tree_node*, bool> insert_unique(const K& value, Make make) {
+        int pr = rand();
+
+        // the new node takes the place of the first node with smaller priority on the search path
+        tree_node* parent = nullptr;
+        tree_node** link = &root;
+        while (*link && (*link)->prior > pr) {
+            parent = *link;
+            push(parent);
+            if (compare()(value, parent->key)) link = &parent->l;
+            else if (compare()(parent->key, value)) link = &parent->r;
+            else return { parent, false };
+        }
+
+        for (tree_node* v = *link; v;) {
+            push(v);
+            if (compare()(value, v->key)) v = v->l;
+            else if (compare()(v->key, value)) v = v->r;
+            else return { v, false };
+        }
+
+        tree_node* nw = make();
+        nw->prior = pr;
+
+        // value may be moved into the node by make()
+        node_pair res = split(*link, nw->key);
+        nw->l = res.first;
+        nw->r = res.second;
+        nw->update_node();
+        nw->par = parent;
+        *link = nw;
+
+        fix_path(parent, 1);
+        return { nw, true };
+    }
+
+    /*
+        The same as insert_unique, but the search starts from node hint by finger search.
+        The new node rises from the leaf over the ancestors with smaller priority,
+        which are exactly the nodes it would replace descending from the root.
+    */
+    template<class K, class Make>
+    std::pair<tree_node*, bool> insert_hinted(tree_node* hint, const K& value, Make make) {
+        tree_node* parent = finger(hint, value).first;
+        if (!parent) return insert_unique(value, make);
+
+        int pr = rand();
+        tree_node** link;
+        while (true) {
+            push(parent);
+            if (compare()(value, parent->key)) link = &parent->l;
+            else if (compare()(parent->key, value)) link = &parent->r;
+            else return { parent, false };
+
+            if (!*link) break;
+            parent = *link;
+        }
+
+        tree_node* nw = make();
+        nw->prior = pr;
+
+        if (parent->prior <= pr) {
+            tree_node* sub = parent;
+            while (sub->par && sub->par->prior <= pr) sub = sub->par;
+            parent = sub->par;
+            link = !parent ? &root : (parent->l == sub ? &parent->l : &parent->r);
         }
+
+        node_pair res = split(*link, nw->key);
+        nw->l = res.first;
+        nw->r = res.second;
+        nw->update_node();
+        nw->par = parent;
+        *link = nw;
+
+        fix_path(parent, 1);
+        return { nw, true };
     }
 
-    // merges two trees such that all keys in l are smaller than keys in r
-    tree_node* merge(tree_node* l, tree_node* r) {
-        if (!l) return r;
-        if (!r) return l;
-
-        if (l->prior < r->prior) {
-            l->r = merge(l->r, r);
-            l->update_node();
-            return l;
-        } else {
-            r->l = merge(l, r->l);
-            r->update_node();
-            return r;
+    // fixes sizes and aggregates of v and its ancestors after d keys were added to the subtree of v
+    static void fix_path(tree_node* v, int d) {
+        for (; v; v = v->par) {
+            push(v);
+            v->size += d;
+            v->update_aggregate();
         }
     }
 
-    // Recursive implementation of insertion in Treap using rotation
-    tree_node* insert(tree_node* v, _key key) {
-        if (!v) return (new tree_node(key));
+    // changes the multiplicity of the key of v by d
+    static void add_count(tree_node* v, int d) {
+        v->cnt += d;
+        fix_path(v, d);
+    }
 
-        if (compare()(key, v->key)) {
-            v->l = insert(v->l, key);
+    // unlinks node v from the tree, v is left without children
+    void unlink_node(tree_node* v) {
+        push(v);
+        tree_node* parent = v->par;
+        tree_node* sub = merge(v->l, v->r);
+        if (sub) sub->par = parent;
 
-            if (v->l->prior > v->prior) v = rightRotate(v);
+        if (!parent) {
+            root = sub;
         } else {
-            v->r = insert(v->r, key);
-
-            if (v->r->prior > v->prior) v = leftRotate(v);
+            (parent->l == v ? parent->l : parent->r) = sub;
+            fix_path(parent, -v->cnt);
         }
 
-        v->update_node();
-        return v;
+        v->l = v->r = v->par = nullptr;
+    }
+
+    // unlinks node v from the tree and returns it to the pool
+    void erase_node(tree_node* v) {
+        unlink_node(v);
+        get_pool().destroy(v);
     }
 
     /*
@@ -147,9 +609,11 @@ private:
         to node with the smallest value which exceed _key value.
     */
 
-    tree_node* find(tree_node* v, _key value) const {
+    template<class K>
+    tree_node* find(tree_node* v, const K& value) const {
         if (v == nullptr) return endnode;
         while (compare()(v->key, value) | compare()(value, v->key)) {
+            push(v);
             if (compare()(v->key, value)) {
                 if (!v->r) break;
                 v = v->r;
@@ -161,449 +625,2929 @@ private:
         return v;
     }
 
-    void upd_end() {
-        endnode->l = root;
-        endnode->r = root;
+    /*
+        Builds a treap from nodes in key order in linear time.
+        The right spine is kept on a stack, nodes popped from it have their subtrees completed.
+    */
+    template<class It>
+    static tree_node* build(It first, It last) {
+        node_stack spine;
+        for (; first != last; ++first) {
+            tree_node* v = *first, * lst = nullptr;
+            while (!spine.empty()) {
+                tree_node* u = spine.pop();
+                if (u->prior >= v->prior) {
+                    u->r = v;
+                    spine.push(u);
+                    break;
+                }
+                u->update_node();
+                lst = u;
+            }
+
+            v->l = lst;
+            spine.push(v);
+        }
+
+        tree_node* res = nullptr;
+        while (!spine.empty()) {
+            res = spine.pop();
+            res->update_node();
+        }
+        return res;
     }
 
-    tree_node* root = nullptr;
-    tree_node* endnode = nullptr;
-public:
-    explicit order_statistic_tree() {
-        endnode = new tree_node();
-        endnode->l = root;
-        endnode->r = root;
+    // builds a treap of new nodes from keys of the range, sorted ranges are handled in linear time
+    template<class InputIt>
+    tree_node* build_nodes(InputIt first, InputIt last) {
+        node_list nodes(get_allocator());
+        if constexpr (std::is_base_of<std::forward_iterator_tag,
+                      typename std::iterator_traits<InputIt>::iterator_category>::value) {
+            size_t n = std::distance(first, last);
+            get_pool().reserve(n);
+            nodes.reserve(n);
+        }
+
+        bool sorted = true;
+        for (; first != last; ++first) {
+            tree_node* v = get_pool().create(*first);
+            v->prior = rand();
+            v->size = int(nodes.size());
+            nodes.push_back(v);
+            if (nodes.size() > 1 && compare()(v->key, nodes[nodes.size() - 2]->key)) sorted = false;
+        }
+
+        node_list removed(get_allocator());
+        sort_unique(nodes, removed, sorted);
+        for (tree_node* v : removed) get_pool().destroy(v);
+
+        return build(nodes.begin(), nodes.end());
     }
 
-    tree_node* copy(tree_node* u) {
-        if (!u) return nullptr;
-        tree_node* v = new tree_node(u);
-        return v;
+    // replaces the content of the tree by keys of the range
+    template<class InputIt>
+    void build_from(InputIt first, InputIt last) {
+        root = build_nodes(first, last);
+        upd_end();
     }
-    order_statistic_tree(const order_statistic_tree<_key, compare>& rt) {
-        delete endnode;
-        endnode = new tree_node();
-        clear();
-        root = nullptr;
-        endnode->l = root;
-        endnode->r = root;
 
-        root = copy(rt.root);
+    /*
+        Sorts nodes by key unless they are sorted already, all but the first of equal keys are moved to removed
+        just as repeated insert does. In multiset mode the first node counts the copies of the removed ones.
+        The size field of every node holds its position in the range, it breaks ties instead of a stable sort,
+        which would take a buffer from the heap.
+    */
+    static void sort_unique(node_list& nodes, node_list& removed, bool sorted) {
+        auto less = [](tree_node* a, tree_node* b) { return compare()(a->key, b->key); };
+        if (!sorted) std::sort(nodes.begin(), nodes.end(), [&](tree_node* a, tree_node* b) {
+            return less(a, b) || (!less(b, a) && a->size < b->size);
+        });
+
+        size_t cnt = 0;
+        for (tree_node* v : nodes) {
+            if (cnt && !less(nodes[cnt - 1], v)) {
+                if (multi) nodes[cnt - 1]->cnt += v->cnt;
+                removed.push_back(v);
+            } else {
+                nodes[cnt++] = v;
+            }
+        }
+        nodes.resize(cnt);
+    }
+
+    /*
+        Parallel version of build_from. The range is cut into chunks, nodes of every chunk are constructed,
+        sorted and built into a treap by a separate task, then the treaps are united pairwise.
+    */
+    template<class RandomIt>
+    void build_from(RandomIt first, RandomIt last, const order_statistic_parallel_policy& policy) {
+        size_t n = last - first;
+        if (n == 0) return;
+
+        size_t chunks = std::max<size_t>(1, std::min<size_t>(policy.threads, n / std::max<size_t>(policy.grain, 1)));
+        tree_node* block = get_pool().allocate_block(n);
+        node_pool& p = get_pool();
+
+        std::vector<tree_node*> roots(chunks);
+        std::vector<node_list> removed(chunks);
+        std::vector<std::future<void>> tasks;
+        for (size_t c = 0; c < chunks; c++) {
+            unsigned seed = rand();
+            tasks.push_back(std::async(std::launch::async, [&, c, seed]() {
+                std::mt19937 gen(seed);
+                node_list nodes;
+                bool sorted = true;
+                for (size_t i = c * n / chunks; i < (c + 1) * n / chunks; i++) {
+                    p.construct(block + i, first[i]);
+                    block[i].prior = int(gen() >> 1);
+                    block[i].size = int(i);
+                    nodes.push_back(block + i);
+                    if (nodes.size() > 1 && compare()(nodes.back()->key, nodes[nodes.size() - 2]->key)) sorted = false;
+                }
+
+                sort_unique(nodes, removed[c], sorted);
+                roots[c] = build(nodes.begin(), nodes.end());
+            }));
+        }
+        for (auto& task : tasks) task.get();
+
+        // unite keeps the nodes of its first tree, so of equal keys the first one of the range stays as in build_from
+        while (roots.size() > 1) {
+            tasks.clear();
+            size_t pairs = roots.size() / 2;
+            fork_budget budget(order_statistic_parallel_policy{ unsigned(std::max<size_t>(1, policy.threads / pairs)), policy.grain });
+            for (size_t c = 0; c + 1 < roots.size(); c += 2) {
+                tasks.push_back(std::async(std::launch::async, [&, c]() {
+                    roots[c] = unite(roots[c], roots[c + 1], removed[c], budget);
+                }));
+            }
+            for (auto& task : tasks) task.get();
+
+            size_t cnt = 0;
+            for (size_t c = 0; c < roots.size(); c += 2) roots[cnt++] = roots[c];
+            roots.resize(cnt);
+        }
+
+        for (auto& list : removed) {
+            for (tree_node* v : list) dispose(v);
+        }
+
+        root = roots[0];
+        upd_end();
     }
 
-    order_statistic_tree<_key, compare>& operator=(const order_statistic_tree<_key, compare>& rt) {
-        delete endnode;
-        endnode = new tree_node();
-        clear();
-        root = nullptr;
-        endnode->l = root;
-        endnode->r = root;
+    // number of nodes in the subtree, in multiset mode it is less than the size if some keys have copies
+    static size_t node_count(tree_node* v) {
+        if (!multi) return size(v);
 
-        root = copy(rt.root);
-        return *this;
+        size_t n = 0;
+        for_each_node(v, [&](tree_node*) { ++n; });
+        return n;
     }
 
-    order_statistic_tree(order_statistic_tree<_key, compare>&& rt) {
-        endnode = rt.endnode;
-        root = rt.root;
+    // copies the subtree with its shape, sizes and priorities, all nodes are taken from a single slab
+    tree_node* clone(tree_node* v) {
+        if (!v) return nullptr;
+        get_pool().reserve(node_count(v));
+
+        // a copy keeps the children of the original until they are copied in turn
+        auto copy_node = [&](const tree_node* u, tree_node* par) {
+            tree_node* w = get_pool().create(u->key);
+            w->prior = u->prior;
+            w->size = u->size;
+            w->cnt = u->cnt;
+            static_cast<aggregate_base&>(*w) = static_cast<const aggregate_base&>(*u);
+            static_cast<shift_base&>(*w) = static_cast<const shift_base&>(*u);
+            w->l = u->l;
+            w->r = u->r;
+            w->par = par;
+            return w;
+        };
+
+        tree_node* res = copy_node(v, nullptr);
+        node_stack st;
+        st.push(res);
+        while (!st.empty()) {
+            tree_node* w = st.pop();
+            if (w->l) {
+                w->l = copy_node(w->l, w);
+                st.push(w->l);
+            }
+            if (w->r) {
+                w->r = copy_node(w->r, w);
+                st.push(w->r);
+            }
+        }
 
-        rt.root = nullptr;
-        rt.upd_end();
+        return res;
     }
 
-    order_statistic_tree<_key, compare>& operator=(order_statistic_tree<_key, compare>&& rt) {
-        endnode = rt.endnode;
-        root = rt.root;
+    // calls f for every node of the subtree, f may destroy the node
+    template<class F>
+    static void for_each_node(tree_node* v, F f) {
+        node_stack st;
+        if (v) st.push(v);
+        while (!st.empty()) {
+            v = st.pop();
+            if (v->l) st.push(v->l);
+            if (v->r) st.push(v->r);
+            f(v);
+        }
+    }
 
-        rt.root = nullptr;
-        rt.upd_end();
-        return *this;
+    /*
+        Returns the pool nodes are allocated from. A tree gets its pool and its own end node
+        here on first use, so empty and moved-from trees own no memory.
+    */
+    node_pool& get_pool() {
+        if (!pool) {
+            std::shared_ptr<node_pool> created = std::allocate_shared<node_pool>(alloc, alloc);
+            endnode = created->create_sentinel();
+            pool = std::move(created);
+            upd_end();
+        }
+        return *pool;
     }
 
-    [[nodiscard]] bool empty() const {
-        return (root == nullptr);
+    // gives up the pool and the end node of the empty tree, it takes new ones on next use
+    void drop_pool() {
+        if (!pool) return;
+        pool->destroy_sentinel(endnode);
+        endnode = empty_end();
+        pool.reset();
+    }
+
+    // end node of trees without a pool, it is never written since such trees are empty
+    static tree_node* empty_end() {
+        static tree_node sentinel;
+        return &sentinel;
+    }
+
+    /*
+        Takes the node out of the handle for use in this tree, see node_type. A node of another pool
+        has its key moved to a new node of this pool and is given back to its pool as by another thread.
+    */
+    template<class Handle>
+    tree_node* take_node(Handle& nh) {
+        node_pool& mine = get_pool();
+        node_pool& theirs = nh.get_pool();
+
+        tree_node* v = nh.node;
+        nh.node = nullptr;
+        if (&mine != &theirs) {
+            tree_node* w = mine.create(std::move(v->key));
+            theirs.destroy_remote(v);
+            v = w;
+        }
+        return v;
+    }
+
+    /*
+        Takes all nodes of other for use in this tree and returns their root, other is left empty
+        and does not share a pool with this tree afterwards. Nodes of the same pool are taken as they are,
+        a pool owned by other alone is merged in O(1) per slab if the allocators are equal,
+        otherwise the nodes are copied. Nodes of a pool other shares with further trees or node handles
+        are given back to it as by another thread, so those may be used concurrently with this tree.
+    */
+    tree_node* adopt(order_statistic_tree& other) {
+        if (!other.root) return nullptr;
+
+        node_pool& mine = get_pool();
+        node_pool& theirs = other.get_pool();
+
+        tree_node* res = other.root;
+        if (&mine != &theirs) {
+            if (other.pool.use_count() == 1 && mine.get_allocator() == theirs.get_allocator()) {
+                mine.absorb(theirs);
+            } else {
+                res = clone(other.root);
+                if (other.pool.use_count() == 1) other.clear();
+                else for_each_node(other.root, [&](tree_node* v) { theirs.destroy_remote(v); });
+            }
+        }
+
+        other.root = nullptr;
+        other.drop_pool();
+        return res;
+    }
+
+    // ------------- set operations, all nodes of both trees are reused or given back to the pool -------------
+
+    // number of levels of recursion which may still fork and the smallest amount of keys worth a fork
+    struct fork_budget {
+        unsigned levels = 0;
+        size_t grain = 0;
+
+        fork_budget() = default;
+
+        explicit fork_budget(const order_statistic_parallel_policy& policy) : grain(policy.grain) {
+            while ((1u << levels) < policy.threads) ++levels;
+        }
+
+        fork_budget next() const {
+            fork_budget res = *this;
+            if (res.levels) --res.levels;
+            return res;
+        }
+    };
+
+    // runs left in a separate task if the budget allows it, garbage of both calls ends up in garbage
+    template<class L, class R>
+    static void fork_join(const fork_budget& budget, size_t work, node_list& garbage, L left, R right) {
+        if (!budget.levels || work < budget.grain) {
+            left(garbage);
+            right(garbage);
+            return;
+        }
+
+        node_list left_garbage;
+        auto task = std::async(std::launch::async, [&]() { left(left_garbage); });
+        right(garbage);
+        task.get();
+        garbage.insert(garbage.end(), left_garbage.begin(), left_garbage.end());
+    }
+
+    // gives all nodes of the subtree back to the pool
+    void dispose(tree_node* v) {
+        node_pool& p = get_pool();
+        for_each_node(v, [&](tree_node* u) { p.destroy(u); });
+    }
+
+    /*
+        The root with larger priority stays the root, the other tree is split by its key.
+        Of two equal keys the node of a stays in the tree, so iterators to it remain valid,
+        and the node of b is given back. If b has the root, the node of a takes its place.
+    */
+    static tree_node* unite(tree_node* a, tree_node* b, node_list& garbage, fork_budget budget) {
+        if (!a) return b;
+        if (!b) return a;
+
+        size_t work = a->size + b->size;
+        if (a->prior >= b->prior) {
+            push(a);
+            node_pair q = split(b, a->key);
+            node_pair q2 = spliteq(q.second, a->key);
+            if (q2.first) {
+                if (multi) a->cnt += q2.first->cnt;
+                garbage.push_back(q2.first);
+            }
+
+            fork_join(budget, work, garbage,
+                [&](node_list& g) { a->l = unite(a->l, q.first, g, budget.next()); },
+                [&](node_list& g) { a->r = unite(a->r, q2.second, g, budget.next()); });
+            a->update_node();
+            return a;
+        }
+
+        push(b);
+        node_pair q = split(a, b->key);
+        node_pair q2 = spliteq(q.second, b->key);
+        tree_node* top = b;
+        if (q2.first) {
+            // q2.first is a single node with the key of b
+            top = q2.first;
+            top->prior = b->prior;
+            if (multi) top->cnt += b->cnt;
+            top->l = b->l;
+            top->r = b->r;
+            b->l = b->r = nullptr;
+            garbage.push_back(b);
+        }
+
+        fork_join(budget, work, garbage,
+            [&](node_list& g) { top->l = unite(q.first, top->l, g, budget.next()); },
+            [&](node_list& g) { top->r = unite(q2.second, top->r, g, budget.next()); });
+        top->update_node();
+        return top;
+    }
+
+    // keys in both trees, the nodes of a stay as in unite
+    static tree_node* intersect(tree_node* a, tree_node* b, node_list& garbage, fork_budget budget) {
+        if (!a || !b) {
+            if (a) garbage.push_back(a);
+            if (b) garbage.push_back(b);
+            return nullptr;
+        }
+        bool mine = a->prior >= b->prior;
+        if (!mine) std::swap(a, b);
+        push(a);
+
+        size_t work = a->size + b->size;
+        node_pair q = split(b, a->key);
+        node_pair q2 = spliteq(q.second, a->key);
+        tree_node* l = nullptr, * r = nullptr;
+        fork_join(budget, work, garbage,
+            [&](node_list& g) { l = mine ? intersect(a->l, q.first, g, budget.next()) : intersect(q.first, a->l, g, budget.next()); },
+            [&](node_list& g) { r = mine ? intersect(a->r, q2.second, g, budget.next()) : intersect(q2.second, a->r, g, budget.next()); });
+
+        a->l = a->r = nullptr;
+        if (!q2.first) {
+            garbage.push_back(a);
+            return merge(l, r);
+        }
+
+        tree_node* keep = mine ? a : q2.first;
+        tree_node* drop = mine ? q2.first : a;
+        keep->prior = a->prior;
+        if (multi) keep->cnt = std::min(a->cnt, q2.first->cnt);
+        garbage.push_back(drop);
+        keep->l = l;
+        keep->r = r;
+        keep->update_node();
+        return keep;
+    }
+
+    // keys of a which are not in b
+    static tree_node* subtract(tree_node* a, tree_node* b, node_list& garbage, fork_budget budget) {
+        if (!a || !b) {
+            if (b) garbage.push_back(b);
+            return a;
+        }
+
+        push(b);
+        size_t work = size(a) + b->size;
+        node_pair q = split(a, b->key);
+        node_pair q2 = spliteq(q.second, b->key);
+
+        // q2.first is a single node with the key of b
+        tree_node* rest = nullptr;
+        if (q2.first && multi && q2.first->cnt > b->cnt) {
+            rest = q2.first;
+            rest->cnt -= b->cnt;
+            rest->update_node();
+        } else if (q2.first) {
+            garbage.push_back(q2.first);
+        }
+
+        tree_node* bl = b->l, * br = b->r;
+        b->l = b->r = nullptr;
+        garbage.push_back(b);
+
+        tree_node* l = nullptr, * r = nullptr;
+        fork_join(budget, work, garbage,
+            [&](node_list& g) { l = subtract(q.first, bl, g, budget.next()); },
+            [&](node_list& g) { r = subtract(q2.second, br, g, budget.next()); });
+        return merge(merge(l, rest), r);
+    }
+
+    // applies a set operation to the tree and the nodes of other
+    template<class Op>
+    void set_operation(order_statistic_tree& other, Op op, const order_statistic_parallel_policy& policy) {
+        tree_node* v = adopt(other);
+
+        node_list garbage(get_allocator());
+        root = op(root, v, garbage, fork_budget(policy));
+        for (tree_node* u : garbage) dispose(u);
+
+        upd_end();
+    }
+
+    // keeps the first tree of the pair and returns the second one as a tree sharing the pool
+    order_statistic_tree split_off(node_pair q) {
+        root = q.first;
+        upd_end();
+        return order_statistic_tree(pool, q.second);
+    }
+
+    // wraps the subtree into a tree which shares the pool with this one
+    order_statistic_tree(const std::shared_ptr<node_pool>& shared, tree_node* rt) : alloc(shared->get_allocator()), pool(shared) {
+        endnode = get_pool().create_sentinel();
+        root = rt;
+        upd_end();
+    }
+
+    void upd_end() {
+        if (endnode == empty_end()) return;
+        endnode->l = root;
+        endnode->r = root;
+    }
+
+    // ------------------- implementations of key lookups, K is _key or a type comparable with it ------------------
+
+    template<class K>
+    bool contains_key(const K& value) const {
+        if (!root) return 0;
+
+        const _key& k = find(root, value)->key;
+        return !(compare()(k, value) | compare()(value, k));
+    }
+
+    template<class K>
+    auto find_key(const K& value) const {
+        if (root == nullptr) return end();
+        tree_node* v = find(root, value);
+        if (!(compare()(v->key, value) | compare()(value, v->key))) return const_iterator(v, endnode);
+        return end();
+    }
+
+    // in multiset mode a contained key gets one more copy, the iterator points to the last copy
+    template<class K, class Make>
+    auto insert_key(const K& value, Make make, tree_node* hint = nullptr) {
+        std::pair<tree_node*, bool> res = hint ? insert_hinted(hint, value, make) : insert_unique(value, make);
+        int rep = 0;
+        if (multi && !res.second) {
+            add_count(res.first, 1);
+            rep = res.first->cnt - 1;
+            res.second = true;
+        }
+        upd_end();
+        return std::make_pair(const_iterator(res.first, endnode, rep), res.second);
+    }
+
+    template<class K>
+    void erase_key(const K& a) {
+        if (!root) return;
+
+        tree_node* v = find(root, a);
+        if (!(compare()(v->key, a) | compare()(a, v->key))) erase_node(v);
+
+        upd_end();
+    }
+
+    template<class K>
+    size_t count_key(const K& value) const {
+        if (!root) return 0;
+
+        tree_node* v = find(root, value);
+        return (compare()(v->key, value) | compare()(value, v->key)) ? 0 : v->cnt;
+    }
+
+    /*
+        Finger search: climbs from node v to the smallest subtree whose key range has room for value
+        and returns its root together with the first key after that range, or endnode.
+        Only the ancestors bounding the range are compared with value, O(log d) expected for value d keys away from v.
+        Without a finger, and in trees with lazy_shift where the ancestors of v may hold pending shifts, the search starts at the root.
+    */
+    template<class K>
+    std::pair<tree_node*, tree_node*> finger(tree_node* v, const K& value) const {
+        if (lazy_shift || !v || v == endnode) return { root, endnode };
+
+        if (compare()(value, v->key)) {
+            // the ranges on the way up contain v, so only their lower ends need checks
+            for (; v->par; v = v->par) {
+                if (v->par->l == v) continue;
+                if (compare()(v->par->key, value)) break;
+                if (!compare()(value, v->par->key)) return { v->par, v->par };
+            }
+            return { v, endnode };
+        }
+
+        tree_node* bound = endnode;
+        if (compare()(v->key, value)) {
+            for (; v->par; v = v->par) {
+                if (v->par->r == v) continue;
+                if (compare()(value, v->par->key)) {
+                    bound = v->par;
+                    break;
+                }
+                if (!compare()(v->par->key, value)) return { v->par, v->par };
+            }
+        }
+        return { v, bound };
+    }
+
+    // lower_bound and upper_bound descend once and stop at the first copy of the key
+    template<class K>
+    auto lower_bound_key(const K& a, tree_node* from = nullptr) const {
+        auto [v, res] = finger(from, a);
+        while (v) {
+            push(v);
+            if (compare()(v->key, a)) {
+                v = v->r;
+            } else {
+                res = v;
+                v = v->l;
+            }
+        }
+        return const_iterator(res, endnode);
+    }
+
+    // number of keys less than value, computed top-down without parent links
+    template<class K>
+    size_t count_less(const K& value) const {
+        size_t res = 0;
+        for (tree_node* v = root; v;) {
+            push(v);
+            if (compare()(v->key, value)) {
+                res += size(v->l) + v->cnt;
+                v = v->r;
+            } else {
+                v = v->l;
+            }
+        }
+        return res;
+    }
+
+    // ------------- aggregate queries, only instantiated for trees with augmentation -------------
+
+    static auto aggregate_of(const tree_node* v) {
+        return v ? v->agg : augment::identity();
+    }
+
+    // aggregate of the k smallest keys, copies of a key are counted separately
+    auto prefix_aggregate(size_t k) const {
+        typename augment::value_type res = augment::identity();
+        for (tree_node* v = root; v && k;) {
+            push(v);
+            if (k <= size(v->l)) {
+                v = v->l;
+                continue;
+            }
+
+            size_t m = std::min<size_t>(v->cnt, k - size(v->l));
+            res = augment::combine(res, aggregate_of(v->l));
+            res = augment::combine(res, augment::value(v->key, int(m)));
+            k -= size(v->l) + m;
+            v = v->r;
+        }
+        return res;
+    }
+
+    // aggregate of keys in [lo, hi), the descents to both bounds start from the topmost node inside the range
+    template<class K>
+    auto range_aggregate(const K& lo, const K& hi) const {
+        typename augment::value_type left = augment::identity(), right = augment::identity();
+        if (!compare()(lo, hi)) return left;
+
+        tree_node* v = root;
+        while (v && (compare()(v->key, lo) || !compare()(v->key, hi))) {
+            push(v);
+            v = compare()(v->key, lo) ? v->r : v->l;
+        }
+        if (!v) return left;
+        push(v);
+
+        for (tree_node* u = v->l; u;) {
+            push(u);
+            if (!compare()(u->key, lo)) {
+                left = augment::combine(augment::combine(augment::value(u->key, u->cnt), aggregate_of(u->r)), left);
+                u = u->l;
+            } else {
+                u = u->r;
+            }
+        }
+        for (tree_node* u = v->r; u;) {
+            push(u);
+            if (compare()(u->key, hi)) {
+                right = augment::combine(right, augment::combine(aggregate_of(u->l), augment::value(u->key, u->cnt)));
+                u = u->r;
+            } else {
+                u = u->l;
+            }
+        }
+        return augment::combine(augment::combine(left, augment::value(v->key, v->cnt)), right);
+    }
+
+    /*
+        Finds the first key at which the cumulative aggregate of keys becomes greater than w (strict)
+        or not less than w. Returns the node and the number of its copies needed, less one.
+    */
+    template<class W>
+    std::pair<tree_node*, int> weighted_stat(const W& w, bool strict) const {
+        using T = typename augment::value_type;
+        auto crosses = [&](const T& cum) { return strict ? w < cum : !(cum < w); };
+
+        T acc = augment::identity();
+        for (tree_node* v = root; v;) {
+            push(v);
+            T left = augment::combine(acc, aggregate_of(v->l));
+            if (v->l && crosses(left)) {
+                v = v->l;
+                continue;
+            }
+
+            T with = augment::combine(left, augment::value(v->key, v->cnt));
+            if (crosses(with)) {
+                int lo = 1, hi = v->cnt;
+                while (lo < hi) {
+                    int mid = lo + (hi - lo) / 2;
+                    if (crosses(augment::combine(left, augment::value(v->key, mid)))) hi = mid;
+                    else lo = mid + 1;
+                }
+                return { v, lo - 1 };
+            }
+
+            acc = with;
+            v = v->r;
+        }
+        return { endnode, 0 };
+    }
+
+    template<class K>
+    auto upper_bound_key(const K& a) const {
+        tree_node* res = endnode;
+        for (tree_node* v = root; v;) {
+            push(v);
+            if (!compare()(a, v->key)) {
+                v = v->r;
+            } else {
+                res = v;
+                v = v->l;
+            }
+        }
+        return const_iterator(res, endnode);
+    }
+
+    // in multiset mode moves the copies of the key at ranks k and above to a new node following it,
+    // so that rank k falls on a node boundary
+    void separate_rank(size_t k) {
+        tree_node* v = root;
+        while (v) {
+            push(v);
+            if (k < size(v->l)) {
+                v = v->l;
+            } else if (k < size(v->l) + v->cnt) {
+                break;
+            } else {
+                k -= size(v->l) + v->cnt;
+                v = v->r;
+            }
+        }
+        if (!v || k == size(v->l)) return;
+
+        int rest = v->cnt - int(k - size(v->l));
+        add_count(v, -rest);
+
+        tree_node* w = get_pool().create(v->key);
+        w->prior = rand();
+        w->cnt = rest;
+        w->update_node();
+
+        node_pair q = spliteq(root, v->key);
+        root = merge(merge(q.first, w), q.second);
+    }
+
+    // splits the tree into its k smallest keys and the rest, rank k must fall on a node boundary
+    static node_pair split_rank(tree_node* v, size_t k) {
+        return split_by(v, [&](tree_node* u) {
+            if (size(u->l) >= k) return false;
+            k -= size(u->l) + u->cnt;
+            return true;
+        });
+    }
+
+    /*
+        Merges trees such that no key in l is greater than keys in r. In multiset mode the last node of l
+        and the first node of r may hold equal keys, such nodes are folded into one.
+    */
+    tree_node* merge_fold(tree_node* l, tree_node* r) {
+        if (multi && l && r) {
+            tree_node* a = last(l);
+            tree_node* b = first(r);
+            if (!compare()(a->key, b->key)) {
+                node_pair q = split_rank(r, b->cnt);
+                add_count(a, b->cnt);
+                dispose(q.first);
+                r = q.second;
+            }
+        }
+        return merge(l, r);
+    }
+
+    // cuts out keys with ranks in [from, to) and gives their nodes back to the pool
+    void erase_ranks(size_t from, size_t to) {
+        if (from >= to) return;
+        if (multi) {
+            // copies of a single key just lose some of their count
+            std::pair<tree_node*, int> v = const_iterator::descend(root, from);
+            if (to - from < size_t(v.first->cnt) && v.second + (to - from) <= size_t(v.first->cnt)) {
+                add_count(v.first, -int(to - from));
+                upd_end();
+                return;
+            }
+
+            separate_rank(from);
+            separate_rank(to);
+        }
+
+        node_pair q = split_rank(root, from);
+        node_pair q2 = split_rank(q.second, to - from);
+        dispose(q2.first);
+        root = merge_fold(q.first, q2.second);
+        upd_end();
+    }
+
+    template<class K>
+    size_t erase_key_range(const K& lo, const K& hi) {
+        if (!compare()(lo, hi)) return 0;
+
+        node_pair q = split(root, lo);
+        node_pair q2 = split(q.second, hi);
+        size_t res = size(q2.first);
+        dispose(q2.first);
+        root = merge(q.first, q2.second);
+        upd_end();
+        return res;
+    }
+
+    // ------------------- batched lookups -------------------
+
+    static void prefetch(const tree_node* v) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(v);
+#endif
+    }
+
+    // number of queries whose descents are interleaved
+    static constexpr size_t batch_group = 16;
+
+    template<class ForwardIt>
+    struct batch_query {
+        ForwardIt q;
+        tree_node* v;
+        tree_node* res;
+        // keys skipped to the left by a rank descent and the position among the copies of the found key
+        long long skipped;
+        int rep;
+    };
+
+    /*
+        Answers the queries in [first, last) by descents which run batch_group at a time in lockstep.
+        step(query) moves the query one level down from its pushed node v and sets v to nullptr when it is answered,
+        the next node of every query is prefetched before the other queries of the group make their steps,
+        so the cache misses of the group overlap instead of stalling each level of each query.
+    */
+    template<class ForwardIt, class OutputIt, class Step, class Answer>
+    OutputIt batch_descend(ForwardIt first, ForwardIt last, OutputIt out, Step step, Answer answer) const {
+        batch_query<ForwardIt> group[batch_group];
+        while (first != last) {
+            size_t n = 0;
+            for (; n < batch_group && first != last; ++first) group[n++] = { first, root, endnode, 0, 0 };
+
+            for (bool active = true; active;) {
+                active = false;
+                for (size_t i = 0; i < n; i++) {
+                    batch_query<ForwardIt>& c = group[i];
+                    if (!c.v) continue;
+
+                    push(c.v);
+                    step(c);
+                    if (c.v) {
+                        prefetch(c.v);
+                        active = true;
+                    }
+                }
+            }
+
+            for (size_t i = 0; i < n; i++) *out++ = answer(group[i]);
+        }
+        return out;
+    }
+
+    Allocator alloc;
+    // created by get_pool() on first use together with the end node
+    std::shared_ptr<node_pool> pool;
+    tree_node* root = nullptr;
+    tree_node* endnode = empty_end();
+public:
+    explicit order_statistic_tree(const Allocator& alloc = Allocator()) noexcept : alloc(alloc) {}
+
+    template<class InputIt>
+    order_statistic_tree(InputIt first, InputIt last, const Allocator& alloc = Allocator()) : order_statistic_tree(alloc) {
+        build_from(first, last);
+    }
+
+    order_statistic_tree(std::initializer_list<_key> init, const Allocator& alloc = Allocator())
+        : order_statistic_tree(init.begin(), init.end(), alloc) {}
+
+    // builds the tree with fork-join parallelism, see assign
+    template<class RandomIt>
+    order_statistic_tree(RandomIt first, RandomIt last, const order_statistic_parallel_policy& policy,
+                         const Allocator& alloc = Allocator()) : order_statistic_tree(alloc) {
+        build_from(first, last, policy);
+    }
+
+    // replaces the content by keys of the range, a sorted range is taken in linear time
+    template<class InputIt>
+    void assign(InputIt first, InputIt last) {
+        clear();
+        build_from(first, last);
+    }
+
+    // parallel version of assign for random access ranges
+    template<class RandomIt>
+    void assign(RandomIt first, RandomIt last, const order_statistic_parallel_policy& policy) {
+        clear();
+        build_from(first, last, policy);
+    }
+
+    order_statistic_tree(const order_statistic_tree& rt)
+        : order_statistic_tree(std::allocator_traits<Allocator>::select_on_container_copy_construction(rt.get_allocator())) {
+        root = clone(rt.root);
+        upd_end();
+    }
+
+    order_statistic_tree& operator=(const order_statistic_tree& rt) {
+        if (this == &rt) return *this;
+
+        clear();
+        root = clone(rt.root);
+        upd_end();
+        return *this;
+    }
+
+    // takes the pool and the end node of rt, iterators to rt stay valid, rt is left empty without memory
+    order_statistic_tree(order_statistic_tree&& rt) noexcept
+        : alloc(rt.alloc), pool(std::move(rt.pool)), root(std::exchange(rt.root, nullptr)), endnode(std::exchange(rt.endnode, empty_end())) {}
+
+    order_statistic_tree& operator=(order_statistic_tree&& rt) noexcept(
+        std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value ||
+        std::allocator_traits<Allocator>::is_always_equal::value) {
+        if (this == &rt) return *this;
+
+        clear();
+        if (std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value ||
+            get_allocator() == rt.get_allocator()) {
+            if (pool) pool->destroy_sentinel(endnode);
+            if constexpr (std::allocator_traits<Allocator>::propagate_on_container_move_assignment::value) alloc = rt.alloc;
+            pool = std::move(rt.pool);
+            root = std::exchange(rt.root, nullptr);
+            endnode = std::exchange(rt.endnode, empty_end());
+        } else {
+            for (const auto& k : rt) insert(k);
+            rt.clear();
+        }
+        return *this;
+    }
+
+    Allocator get_allocator() const {
+        return alloc;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return (root == nullptr);
+    }
+
+    [[nodiscard]] size_t size() const {
+        return root ? root->size : 0;
+    }
+
+    tree_node* get_root() const {
+        return root;
+    }
+    tree_node* get_end_node() const {
+        return endnode;
+    }
+
+    void change_root(tree_node* rt) {
+        root = rt;
+    }
+
+    void change_end_node(tree_node* nd) {
+        endnode = nd;
+    }
+
+    void swap(order_statistic_tree& rt) noexcept {
+        std::swap(root, rt.root);
+        std::swap(endnode, rt.endnode);
+        std::swap(pool, rt.pool);
+        if constexpr (std::allocator_traits<Allocator>::propagate_on_container_swap::value) std::swap(alloc, rt.alloc);
+    }
+
+    /*
+        Clears the tree. If no other tree shares the pool, the memory is released
+        with O(1) allocator calls per slab, otherwise the nodes are given back to the pool.
+    */
+    void clear() {
+        if (!pool) return;
+
+        node_pool& p = get_pool();
+        if (pool.use_count() == 1) {
+            if (!std::is_trivially_destructible<_key>::value) for_each_node(root, [](tree_node* v) { v->~tree_node(); });
+            p.release();
+        } else {
+            for_each_node(root, [&](tree_node* v) { p.destroy(v); });
+        }
+
+        root = nullptr;
+        upd_end();
+    }
+
+    ~order_statistic_tree() {
+        clear();
+        if (pool) pool->destroy_sentinel(endnode);
+    }
+
+    // checks whenever value is contained in the tree
+    bool contains(const _key& value) const {
+        return contains_key(value);
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    bool contains(const K& value) const {
+        return contains_key(value);
+    }
+
+    template<bool isReversed>
+    class BaseIterator {
+    private:
+        tree_node* ptr, * endnode;
+        // position among the copies of the key in multiset mode
+        int rep = 0;
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = _key;
+        using reference = const _key&;
+        using pointer = const _key*;
+        using difference_type = std::ptrdiff_t;
+
+        BaseIterator() : ptr(nullptr), endnode(nullptr) {}
+
+        explicit BaseIterator(tree_node* ptr, tree_node* endnode, int rep = 0) : ptr(ptr), endnode(endnode), rep(rep) {}
+
+        template<bool isReversedOther>
+        explicit BaseIterator(const BaseIterator<isReversedOther>& other)
+            : ptr(other.getPtr()), endnode(other.getEndNode()), rep(other.getRep()) {}
+
+        // returns index of value in set if value exists
+        int get_index(tree_node* v) const {
+            if (v == endnode) return size(v->l);
+            int ind = size(v->l);
+            while (v->par) {
+                if (v->par->r == v) {
+                    ind += size(v->par->l) + v->par->cnt;
+                }
+
+                v = v->par;
+            }
+
+            return ind;
+        }
+
+        tree_node* next(tree_node* v) const {
+            if (v->r) {
+                push(v);
+                for (v = v->r; v->l; v = v->l) push(v);
+                return v;
+            }
+
+            tree_node* pr = v;
+            while (v->l != pr) {
+                if (!v->par) return nullptr;
+                pr = v;
+                v = v->par;
+            }
+
+            return v;
+        }
+
+        tree_node* prev(tree_node* v) const {
+            if (v->l) {
+                push(v);
+                for (v = v->l; v->r; v = v->r) push(v);
+                return v;
+            }
+
+            tree_node* pr = v;
+            while (v->r != pr) {
+                if (!v->par) return nullptr;
+                pr = v;
+                v = v->par;
+            }
+
+            return v;
+        }
+
+        void descendLeft() {
+            for (; ptr->l; ptr = ptr->l) push(ptr);
+        }
+
+        void descendRight() {
+            for (; ptr->r; ptr = ptr->r) push(ptr);
+        }
+
+        // index of the iterator in key order, the end node stands before the first key for reversed iterators
+        difference_type index() const {
+            if (ptr == endnode) return isReversed ? -1 : difference_type(size(endnode->r));
+            return get_index(ptr) + rep;
+        }
+
+        difference_type operator - (const BaseIterator& other) const {
+            return isReversed ? other.index() - index() : index() - other.index();
+        }
+
+        /*
+            Moves the iterator by n keys. The walk climbs from the current node only up to the smallest subtree
+            containing the target and descends from there by rank, so a move by d keys takes O(log d) expected.
+            Moves out of the tree give the end node.
+        */
+        void advance(difference_type n) {
+            difference_type target = isReversed ? -n : n;
+            if (target == 0) return;
+
+            tree_node* v = endnode->r;
+            if (ptr == endnode) {
+                target += isReversed ? -1 : difference_type(size(v));
+            } else {
+                v = ptr;
+                target += size(v->l) + rep;
+                while (v->par && (target < 0 || target >= difference_type(v->size))) {
+                    if (v->par->r == v) target += size(v->par->l) + v->par->cnt;
+                    v = v->par;
+                }
+            }
+
+            if (!v || target < 0 || target >= difference_type(size(v))) {
+                ptr = endnode;
+                rep = 0;
+                return;
+            }
+            std::tie(ptr, rep) = descend(v, target);
+        }
+
+        BaseIterator& operator+=(difference_type add) {
+            advance(add);
+            return *this;
+        }
+
+        BaseIterator& operator-=(difference_type add) {
+            advance(-add);
+            return *this;
+        }
+
+        BaseIterator operator+(difference_type add) const {
+            BaseIterator res = *this;
+            res.advance(add);
+            return res;
+        }
+
+        friend BaseIterator operator+(difference_type add, const BaseIterator& it) {
+            return it + add;
+        }
+
+        BaseIterator operator-(difference_type add) const {
+            BaseIterator res = *this;
+            res.advance(-add);
+            return res;
+        }
+
+        const _key& operator[](difference_type n) const {
+            return *(*this + n);
+        }
+
+        void changePtr(tree_node* t) {
+            ptr = t;
+            rep = 0;
+        }
+
+        // returns the node holding the key with rank nd in the subtree of v and the position among the copies of the key
+        static std::pair<tree_node*, int> descend(tree_node* v, difference_type nd) {
+            while (true) {
+                push(v);
+                difference_type left = size(v->l);
+                if (nd < left) {
+                    v = v->l;
+                } else if (nd < left + v->cnt) {
+                    return { v, int(nd - left) };
+                } else {
+                    nd -= left + v->cnt;
+                    v = v->r;
+                }
+            }
+        }
+
+        // ordered statistic implementation, returns the node and the position among the copies of its key
+        std::pair<tree_node*, int> stat(int nd) const {
+            if (nd >= size(endnode->r)) return { endnode, 0 };
+            return descend(endnode->r, nd);
+        }
+
+        // moves to the next key in key order, copies of a key are visited one by one
+        void forward() {
+            if (ptr != endnode && rep + 1 < ptr->cnt) {
+                ++rep;
+                return;
+            }
+
+            if (ptr == endnode) descendLeft();
+            else ptr = next(ptr);
+
+            if (ptr == nullptr) ptr = endnode;
+            rep = 0;
+        }
+
+        void backward() {
+            if (ptr != endnode && rep > 0) {
+                --rep;
+                return;
+            }
+
+            if (ptr == endnode) descendRight();
+            else ptr = prev(ptr);
+
+            if (ptr == nullptr) ptr = endnode;
+            rep = ptr == endnode ? 0 : ptr->cnt - 1;
+        }
+
+        BaseIterator& operator++() {
+            if (!isReversed) forward();
+            else backward();
+            return *this;
+        }
+
+        BaseIterator& operator--() {
+            if (!isReversed) backward();
+            else forward();
+            return *this;
+        }
+
+        BaseIterator operator++(int) {
+            BaseIterator ans = *this;
+            ++(*this);
+            return ans;
+        }
+
+        BaseIterator operator--(int) {
+            BaseIterator ans = *this;
+            --(*this);
+            return ans;
+        }
+
+        bool operator == (const BaseIterator<isReversed>& other) const {
+            return ptr == other.getPtr() && rep == other.getRep();
+        }
+
+        bool operator != (const BaseIterator<isReversed>& other) const {
+            return !(*this == other);
+        }
+
+        bool operator < (const BaseIterator<isReversed>& other) const {
+            return *this - other < 0;
+        }
+
+        bool operator > (const BaseIterator<isReversed>& other) const {
+            return other < *this;
+        }
+
+        bool operator <= (const BaseIterator<isReversed>& other) const {
+            return !(other < *this);
+        }
+
+        bool operator >= (const BaseIterator<isReversed>& other) const {
+            return !(*this < other);
+        }
+
+        const _key& operator* () const {
+            return ptr->key;
+        }
+
+        const _key* operator-> () const {
+            return &ptr->key;
+        }
+
+        tree_node* getPtr() const {
+            return ptr;
+        }
+
+        int getRep() const {
+            return rep;
+        }
+
+        tree_node* getEndNode() const {
+            return endnode;
+        }
+    };
+
+    using const_iterator = BaseIterator<false>;
+    using const_reverse_iterator = BaseIterator<true>;
+    using iterator = BaseIterator<0>;
+    using reverse_iterator = BaseIterator<1>;
+
+    /*
+        Handle owning a node extracted from a tree, the key can be modified through value().
+        Inserting the handle back to its tree links the node without allocation, another tree
+        moves the key to a node of its own. The node is given back to the pool of its tree without
+        touching the tree, so a handle may be inserted or destroyed while its tree is used by another thread.
+    */
+    class node_type {
+    private:
+        friend class order_statistic_tree;
+
+        tree_node* node = nullptr;
+        std::shared_ptr<node_pool> pool;
+
+        node_type(tree_node* v, const std::shared_ptr<node_pool>& p) : node(v), pool(p) {}
+
+        node_pool& get_pool() {
+            return *pool;
+        }
+
+        void reset() {
+            if (node) get_pool().destroy_remote(node);
+            node = nullptr;
+            pool.reset();
+        }
+    public:
+        using value_type = _key;
+        using allocator_type = Allocator;
+
+        node_type() = default;
+
+        node_type(node_type&& other) noexcept : node(std::exchange(other.node, nullptr)), pool(std::move(other.pool)) {}
+
+        node_type& operator=(node_type&& other) noexcept {
+            if (this != &other) {
+                reset();
+                node = std::exchange(other.node, nullptr);
+                pool = std::move(other.pool);
+            }
+            return *this;
+        }
+
+        ~node_type() {
+            reset();
+        }
+
+        [[nodiscard]] bool empty() const {
+            return node == nullptr;
+        }
+
+        explicit operator bool() const {
+            return node != nullptr;
+        }
+
+        _key& value() const {
+            return node->key;
+        }
+
+        Allocator get_allocator() const {
+            return pool->get_allocator();
+        }
+    };
+
+    struct insert_return_type {
+        const_iterator position;
+        bool inserted;
+        node_type node;
+    };
+
+    // returns pointer to the smallest element in set
+    tree_node* first(tree_node* v) const {
+        if (!v) return nullptr;
+        for (; v->l; v = v->l) push(v);
+        return v;
+    }
+
+    // returns pointer to the largest element in set
+    tree_node* last(tree_node* v) const {
+        if (!v) return nullptr;
+        for (; v->r; v = v->r) push(v);
+        return v;
+    }
+
+    const_iterator begin() const {
+        return iterator((root ? first(root) : endnode), endnode);
+    }
+
+    const_reverse_iterator rbegin() const {
+        if (!root) return reverse_iterator(endnode, endnode);
+        tree_node* v = last(root);
+        return reverse_iterator(v, endnode, v->cnt - 1);
+    }
+
+    const_iterator end() const {
+        return iterator(endnode, endnode);
+    }
+
+    const_reverse_iterator rend() const {
+        return reverse_iterator(endnode, endnode);
+    }
+
+    // trees are equal if they contain equal keys
+    bool operator==(const order_statistic_tree& rhs) const {
+        if (size() != rhs.size()) return false;
+        return std::equal(begin(), end(), rhs.begin(), [](const _key& a, const _key& b) {
+            return !(compare()(a, b) | compare()(b, a));
+        });
+    }
+
+    bool operator!=(const order_statistic_tree& rhs) const {
+        return !(*this == rhs);
+    }
+
+    const_iterator find(const _key& value) const {
+        return find_key(value);
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    const_iterator find(const K& value) const {
+        return find_key(value);
+    }
+
+    /*
+        Inserts value if it is not contained yet, returns iterator to value and whenever the insertion took place.
+        In multiset mode value is always inserted, a contained key just gets one more copy.
+    */
+    std::pair<const_iterator, bool> insert(const _key& value) {
+        return insert_key(value, [&]() { return get_pool().create(value); });
+    }
+
+    std::pair<const_iterator, bool> insert(_key&& value) {
+        return insert_key(value, [&]() { return get_pool().create(std::move(value)); });
+    }
+
+    /*
+        Inserts value searching from hint instead of the root, returns iterator to value.
+        Only O(log d) keys are compared when value goes d keys away from hint, so inserting
+        keys in nearly sorted order with the previous result as hint saves most of the comparisons.
+        Sizes of all ancestors are still updated, so the insertion itself stays O(log n).
+    */
+    const_iterator insert(const const_iterator& hint, const _key& value) {
+        return insert_key(value, [&]() { return get_pool().create(value); }, hint.getPtr()).first;
+    }
+
+    const_iterator insert(const const_iterator& hint, _key&& value) {
+        return insert_key(value, [&]() { return get_pool().create(std::move(value)); }, hint.getPtr()).first;
+    }
+
+    /*
+        Inserts keys of the range at once: they are built into a treap in linear time if sorted
+        and merged into the tree by a union, O(m log(n / m + 1)) for m sorted keys instead of m descents.
+        Unsorted ranges are sorted first. In multiset mode every key of the range adds a copy,
+        otherwise a key already in the tree keeps its node, so iterators stay valid, and of equal keys
+        of the range the first one is inserted.
+    */
+    template<class InputIt>
+    void insert_sorted(InputIt first, InputIt last) {
+        node_list garbage(get_allocator());
+        root = unite(root, build_nodes(first, last), garbage, fork_budget());
+        for (tree_node* v : garbage) dispose(v);
+        upd_end();
+    }
+
+    // constructs the key in place, the node is given back if an equal key is already contained
+    template<class... Args>
+    std::pair<const_iterator, bool> emplace(Args&&... args) {
+        tree_node* nw = get_pool().create(std::forward<Args>(args)...);
+        std::pair<const_iterator, bool> res = insert_key(nw->key, [&]() { return nw; });
+        if (res.first.getPtr() != nw) get_pool().destroy(nw);
+        return res;
+    }
+
+    // erases the key with all its copies
+    void erase(const _key& a) {
+        erase_key(a);
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    void erase(const K& a) {
+        erase_key(a);
+    }
+
+    // erases the key the iterator points to, in multiset mode only this copy is erased
+    void erase(const const_iterator& a) {
+        tree_node* v = a.getPtr();
+        if (v == nullptr || v == endnode) {
+            const std::string err = __func__;
+            throw std::invalid_argument(err + " received iterator to an empty node.");
+        }
+
+        if (multi && v->cnt > 1) add_count(v, -1);
+        else erase_node(v);
+        upd_end();
+    }
+
+    /*
+        Unlinks the key the iterator points to and returns it in a handle, in multiset mode a single copy.
+        The handle does not tie the tree to others, it may be inserted to a tree used by another thread.
+    */
+    node_type extract(const const_iterator& a) {
+        tree_node* v = a.getPtr();
+        if (v == nullptr || v == endnode) {
+            const std::string err = __func__;
+            throw std::invalid_argument(err + " received iterator to an empty node.");
+        }
+
+        if (multi && v->cnt > 1) {
+            add_count(v, -1);
+            v = get_pool().create(v->key);
+        } else {
+            unlink_node(v);
+            upd_end();
+        }
+        return node_type(v, pool);
+    }
+
+    // returns an empty handle if value is not contained
+    node_type extract(const _key& value) {
+        const_iterator it = find_key(value);
+        return it == end() ? node_type() : extract(it);
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    node_type extract(const K& value) {
+        const_iterator it = find_key(value);
+        return it == end() ? node_type() : extract(it);
+    }
+
+    /*
+        Links the node of the handle into the tree. If an equal key is contained, the handle is given back
+        in the result, in multiset mode the key gets one more copy and the node is released instead.
+        A handle extracted from another tree costs one node allocation, the trees keep separate pools
+        and may still be modified concurrently.
+    */
+    insert_return_type insert(node_type&& nh) {
+        if (nh.empty()) return { end(), false, node_type() };
+
+        std::pair<tree_node*, bool> res = insert_unique(nh.node->key, [&]() { return take_node(nh); });
+        if (!res.second && !multi) {
+            upd_end();
+            return { const_iterator(res.first, endnode), false, std::move(nh) };
+        }
+
+        int rep = 0;
+        if (!res.second) {
+            add_count(res.first, 1);
+            rep = res.first->cnt - 1;
+            nh = node_type();
+        }
+        upd_end();
+        return { const_iterator(res.first, endnode, rep), true, node_type() };
+    }
+
+    // erases the k-th smallest key, in multiset mode a single copy
+    void erase_at(size_t k) {
+        if (k >= size()) {
+            const std::string err = __func__;
+            throw std::out_of_range(err + " received a rank out of the tree.");
+        }
+        erase(statistic(k));
+    }
+
+    /*
+        Erases keys of [first, last) in O(log n + m) for m erased nodes: the range is detached with two splits
+        and its nodes are given back at once. Returns the iterator following the erased keys.
+    */
+    const_iterator erase(const const_iterator& first, const const_iterator& last) {
+        auto rank_of = [&](const const_iterator& it) {
+            return it.getPtr() == endnode ? size() : it.get_index(it.getPtr()) + it.getRep();
+        };
+
+        size_t from = rank_of(first);
+        erase_ranks(from, rank_of(last));
+        return statistic(from);
+    }
+
+    // erases keys in [lo, hi) in O(log n + m) and returns the number of erased keys
+    size_t erase_range(const _key& lo, const _key& hi) {
+        return erase_key_range(lo, hi);
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    size_t erase_range(const K& lo, const K& hi) {
+        return erase_key_range(lo, hi);
+    }
+
+    // returns the number of copies of value, at most 1 unless in multiset mode
+    size_t count(const _key& value) const {
+        return count_key(value);
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    size_t count(const K& value) const {
+        return count_key(value);
+    }
+
+    const_iterator lower_bound(const _key& a) const {
+        return lower_bound_key(a);
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    const_iterator lower_bound(const K& a) const {
+        return lower_bound_key(a);
+    }
+
+    // the same as lower_bound(a), but the search starts from iterator from by finger search, O(log d) for d keys between them
+    const_iterator lower_bound(const const_iterator& from, const _key& a) const {
+        return lower_bound_key(a, from.getPtr());
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    const_iterator lower_bound(const const_iterator& from, const K& a) const {
+        return lower_bound_key(a, from.getPtr());
+    }
+
+    /*
+        Writes lower_bound of every key of the range to out and returns the end of the output range.
+        Each search starts from the previous answer by finger search, so for sorted keys the tree is walked
+        in key order once, O(m log(n / m + 1)) for m keys. Keys in any other order give correct answers as well.
+    */
+    template<class InputIt, class OutputIt>
+    OutputIt lower_bound_sorted(InputIt first, InputIt last, OutputIt out) const {
+        tree_node* from = nullptr;
+        for (; first != last; ++first) {
+            const_iterator it = lower_bound_key(*first, from);
+            from = it.getPtr();
+            *out++ = it;
+        }
+        return out;
+    }
+
+    const_iterator upper_bound(const _key& a) const {
+        return upper_bound_key(a);
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    const_iterator upper_bound(const K& a) const {
+        return upper_bound_key(a);
+    }
+
+    // returns the number of keys less than value
+    size_t order_of_key(const _key& value) const {
+        return count_less(value);
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    size_t order_of_key(const K& value) const {
+        return count_less(value);
+    }
+
+    // returns the number of keys in [lo, hi)
+    size_t count_range(const _key& lo, const _key& hi) const {
+        return compare()(lo, hi) ? count_less(hi) - count_less(lo) : 0;
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    size_t count_range(const K& lo, const K& hi) const {
+        return compare()(lo, hi) ? count_less(hi) - count_less(lo) : 0;
+    }
+
+    /*
+        Aggregates of the augmentation policy in O(log n), available only for trees with augment given.
+        aggregate is taken over all keys, aggregate_prefix over the k smallest ones
+        and aggregate_range over keys in [lo, hi). Copies of a key in multiset mode are counted separately.
+    */
+    auto aggregate() const {
+        static_assert(augmented, "aggregate queries need an augmentation policy");
+        return aggregate_of(root);
+    }
+
+    auto aggregate_prefix(size_t k) const {
+        static_assert(augmented, "aggregate queries need an augmentation policy");
+        return prefix_aggregate(k);
+    }
+
+    auto aggregate_range(const _key& lo, const _key& hi) const {
+        static_assert(augmented, "aggregate queries need an augmentation policy");
+        return range_aggregate(lo, hi);
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    auto aggregate_range(const K& lo, const K& hi) const {
+        static_assert(augmented, "aggregate queries need an augmentation policy");
+        return range_aggregate(lo, hi);
+    }
+
+    /*
+        Weighted order statistics in O(log n) for trees augmented with a sum of nonnegative weights,
+        e.g. order_statistic_sum or a policy summing weights stored in the keys.
+        weighted_statistic returns the first key at which the cumulative weight exceeds w, end() if there is none.
+        percentile returns the first key at which the cumulative weight reaches the fraction p of the total weight.
+    */
+    template<class W>
+    const_iterator weighted_statistic(const W& w) const {
+        static_assert(augmented, "weighted queries need an augmentation policy");
+        std::pair<tree_node*, int> res = weighted_stat(w, true);
+        return const_iterator(res.first, endnode, res.second);
+    }
+
+    const_iterator percentile(double p) const {
+        static_assert(augmented, "weighted queries need an augmentation policy");
+        if (!root) return end();
+
+        std::pair<tree_node*, int> res = weighted_stat(std::min(std::max(p, 0.0), 1.0) * aggregate_of(root), false);
+        if (res.first == endnode) {
+            // rounding of p * total may leave the last key out
+            res.first = last(root);
+            res.second = res.first->cnt - 1;
+        }
+        return const_iterator(res.first, endnode, res.second);
+    }
+
+    /*
+        Adds d to every key in [lo, hi] in O(log n), the tree must have lazy_shift set.
+        The shifted keys must stay strictly between the keys outside the range, otherwise nothing is changed
+        and std::invalid_argument is thrown. Iterators to the shifted keys are invalidated.
+        Since const member functions push pending shifts down, such trees must not be read by several threads at once.
+    */
+    void shift_range(const _key& lo, const _key& hi, const _key& d) {
+        static_assert(lazy_shift, "shift_range needs lazy_shift");
+        node_pair q = split(root, lo);
+        node_pair q2 = spliteq(q.second, hi);
+
+        bool ordered = !q2.first || ((!q.first || compare()(last(q.first)->key, first(q2.first)->key + d)) &&
+                                     (!q2.second || compare()(last(q2.first)->key + d, first(q2.second)->key)));
+        if (ordered && q2.first) shift_subtree(q2.first, d);
+
+        root = merge(merge(q.first, q2.first), q2.second);
+        upd_end();
+
+        if (!ordered) {
+            const std::string err = __func__;
+            throw std::invalid_argument(err + " received a shift which changes the order of keys.");
+        }
+    }
+
+    /*
+        Keeps keys less than value and returns the tree of the other keys in O(log n).
+        The returned tree shares the node pool with this one until it is joined to a tree or destroyed,
+        so meanwhile they must not be modified concurrently and clear() gives nodes back one by one.
+    */
+    order_statistic_tree split_at_key(const _key& value) {
+        return split_off(split(root, value));
+    }
+
+    template<class K, class C = compare, class = typename C::is_transparent>
+    order_statistic_tree split_at_key(const K& value) {
+        return split_off(split(root, value));
+    }
+
+    // keeps k smallest keys and returns the tree of the other keys in O(log n), the pool is shared as in split_at_key
+    order_statistic_tree split_at_rank(size_t k) {
+        if (multi) separate_rank(k);
+        return split_off(split_rank(root, k));
+    }
+
+    /*
+        Moves all keys of other to the tree, other is left empty.
+        All keys of other must be either greater or smaller than all keys of the tree.
+        In multiset mode the boundary key may be in both trees, as after split_at_rank, its copies are added up.
+        Trees never share a pool after a join: a tree split off this one is linked back in O(log n),
+        a tree owning its pool alone has its slabs taken over and a tree split off another one
+        is copied in O(m), so the trees it was split from may be used by other threads meanwhile.
+    */
+    void join(order_statistic_tree&& other) {
+        if (this == &other || !other.root) return;
+
+        // in multiset mode an equal boundary key does not count as an overlap
+        auto before = [](const _key& a, const _key& b) { return multi ? !compare()(b, a) : compare()(a, b); };
+        const _key& other_first = first(other.root)->key;
+        const _key& other_last = last(other.root)->key;
+        bool after = !root || before(last(root)->key, other_first);
+        if (!after && !before(other_last, first(root)->key)) {
+            const std::string err = __func__;
+            throw std::invalid_argument(err + " received a tree with keys overlapping the keys of the tree.");
+        }
+
+        tree_node* v = adopt(other);
+        root = after ? merge_fold(root, v) : merge_fold(v, root);
+        upd_end();
+    }
+
+    /*
+        Set operations with other in O(m log(n / m + 1)) where m is the size of the smaller tree.
+        Nodes of both trees are reused, other is taken by value so pass it with std::move to avoid copying.
+        In multiset mode union adds multiplicities, intersection keeps the smaller one
+        and difference removes as many copies as other has. Of equal keys the element of this tree stays,
+        so iterators to kept elements remain valid, and the element of other is destroyed.
+    */
+    void union_with(order_statistic_tree other) {
+        union_with(std::move(other), order_statistic_parallel_policy{ 1 });
+    }
+
+    void intersect_with(order_statistic_tree other) {
+        intersect_with(std::move(other), order_statistic_parallel_policy{ 1 });
+    }
+
+    void difference_with(order_statistic_tree other) {
+        difference_with(std::move(other), order_statistic_parallel_policy{ 1 });
+    }
+
+    // fork-join versions of set operations, the recursion on left subtrees runs in separate tasks near the root
+    void union_with(order_statistic_tree other, const order_statistic_parallel_policy& policy) {
+        set_operation(other, unite, policy);
+    }
+
+    void intersect_with(order_statistic_tree other, const order_statistic_parallel_policy& policy) {
+        set_operation(other, intersect, policy);
+    }
+
+    void difference_with(order_statistic_tree other, const order_statistic_parallel_policy& policy) {
+        set_operation(other, subtract, policy);
+    }
+
+    // ordered statistic implementation
+    const_iterator statistic(int k) const {
+        if (k >= size()) return end();
+
+        std::pair<tree_node*, int> res = const_iterator(endnode, endnode).stat(k);
+        return const_iterator(res.first, endnode, res.second);
+    }
+
+    /*
+        Batched versions of contains, lower_bound and statistic. The answers for the queries in [first, last)
+        are written to out in the same order and the end of the output range is returned.
+        The descents of independent queries are interleaved with prefetching, which pays off
+        for batches of thousands of queries to a tree that does not fit in cache.
+    */
+    template<class ForwardIt, class OutputIt>
+    OutputIt contains_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        return batch_descend(first, last, out, [](auto& c) {
+            if (compare()(c.v->key, *c.q)) {
+                c.v = c.v->r;
+            } else if (compare()(*c.q, c.v->key)) {
+                c.v = c.v->l;
+            } else {
+                c.res = c.v;
+                c.v = nullptr;
+            }
+        }, [&](const auto& c) { return c.res != endnode; });
+    }
+
+    template<class ForwardIt, class OutputIt>
+    OutputIt lower_bound_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        return batch_descend(first, last, out, [](auto& c) {
+            if (compare()(c.v->key, *c.q)) {
+                c.v = c.v->r;
+            } else {
+                c.res = c.v;
+                c.v = c.v->l;
+            }
+        }, [&](const auto& c) { return const_iterator(c.res, endnode); });
+    }
+
+    // ranks out of [0, size()) give end()
+    template<class ForwardIt, class OutputIt>
+    OutputIt statistic_many(ForwardIt first, ForwardIt last, OutputIt out) const {
+        return batch_descend(first, last, out, [](auto& c) {
+            long long nd = (long long)*c.q - c.skipped, left = size(c.v->l);
+            if (nd < left) {
+                c.v = c.v->l;
+            } else if (nd < left + c.v->cnt) {
+                c.res = c.v;
+                c.rep = int(nd - left);
+                c.v = nullptr;
+            } else {
+                c.skipped += left + c.v->cnt;
+                c.v = c.v->r;
+            }
+        }, [&](const auto& c) { return const_iterator(c.res, endnode, c.rep); });
+    }
+
+    /*
+        Returns an immutable copy of the tree in a pointer-free Eytzinger layout, made in O(n) for n nodes.
+        It answers the same const queries faster, so trees built once and queried many times should be frozen.
+    */
+    frozen_order_statistic_tree<_key, compare, Allocator> freeze() const {
+        using frozen = frozen_order_statistic_tree<_key, compare, Allocator>;
+
+        // in-order walk over the nodes, copies of a key stay in one slot
+        typename frozen::slot_list sorted{ typename frozen::slot_allocator(get_allocator()) };
+        sorted.reserve(node_count(root));
+        node_stack st;
+        for (tree_node* v = root; v || !st.empty();) {
+            if (v) {
+                push(v);
+                st.push(v);
+                v = v->l;
+            } else {
+                v = st.pop();
+                sorted.push_back({ v->key, v->cnt, 0 });
+                v = v->r;
+            }
+        }
+        return frozen(std::move(sorted));
+    }
+};
+
+/*
+    Order statistic tree which keeps equal keys. Each node stores a key with the number of its copies,
+    so repeated keys take no extra memory, while size, statistic and order_of_key count every copy.
+*/
+template<typename _key, class compare = std::less<_key>, class Allocator = std::allocator<_key>,
+         class augment = order_statistic_no_augment, bool lazy_shift = false>
+using order_statistic_multiset = order_statistic_tree<_key, compare, Allocator, true, augment, lazy_shift>;
+
+/*
+    Order statistic tree of key-value pairs ordered by keys.
+    Mapped values are stored in the nodes next to the keys, so a lookup by key and a rank query
+    need a single descent. Iterators give access to const pairs, values are modified with operator[] and at.
+*/
+template<typename _key, typename _value, class compare = std::less<_key>,
+         class Allocator = std::allocator<std::pair<const _key, _value>>>
+class order_statistic_map {
+public:
+    using key_type = _key;
+    using mapped_type = _value;
+    using value_type = std::pair<const _key, _value>;
+private:
+    // orders pairs by keys, pairs are also comparable with keys
+    struct value_compare {
+        using is_transparent = void;
+
+        bool operator()(const value_type& a, const value_type& b) const {
+            return compare()(a.first, b.first);
+        }
+
+        template<class K>
+        bool operator()(const value_type& a, const K& b) const {
+            return compare()(a.first, b);
+        }
+
+        template<class K>
+        bool operator()(const K& a, const value_type& b) const {
+            return compare()(a, b.first);
+        }
+    };
+
+    using tree_type = order_statistic_tree<value_type, value_compare, Allocator>;
+
+    tree_type tree;
+
+    // inserts the pair with the value constructed from args if key is not contained yet, in a single descent
+    template<class K, class... Args>
+    std::pair<typename tree_type::const_iterator, bool> try_emplace_key(K&& key, Args&&... args) {
+        return tree.insert_key(key, [&]() {
+            return tree.get_pool().create(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                                          std::forward_as_tuple(std::forward<Args>(args)...));
+        });
+    }
+
+    static _value& mapped(const typename tree_type::const_iterator& it) {
+        return it.getPtr()->key.second;
+    }
+public:
+    using const_iterator = typename tree_type::const_iterator;
+    using const_reverse_iterator = typename tree_type::const_reverse_iterator;
+    using iterator = const_iterator;
+    using reverse_iterator = const_reverse_iterator;
+
+    explicit order_statistic_map(const Allocator& alloc = Allocator()) : tree(alloc) {}
+
+    // equal keys keep the first pair just as repeated insert does
+    template<class InputIt>
+    order_statistic_map(InputIt first, InputIt last, const Allocator& alloc = Allocator()) : tree(first, last, alloc) {}
+
+    order_statistic_map(std::initializer_list<value_type> init, const Allocator& alloc = Allocator()) : tree(init, alloc) {}
+
+    Allocator get_allocator() const {
+        return tree.get_allocator();
+    }
+
+    [[nodiscard]] bool empty() const {
+        return tree.empty();
+    }
+
+    [[nodiscard]] size_t size() const {
+        return tree.size();
+    }
+
+    void clear() {
+        tree.clear();
+    }
+
+    void swap(order_statistic_map& other) {
+        tree.swap(other.tree);
+    }
+
+    const_iterator begin() const {
+        return tree.begin();
+    }
+
+    const_iterator end() const {
+        return tree.end();
+    }
+
+    const_reverse_iterator rbegin() const {
+        return tree.rbegin();
+    }
+
+    const_reverse_iterator rend() const {
+        return tree.rend();
+    }
+
+    // returns the value mapped to key, a value initialized one is inserted if key is not contained
+    _value& operator[](const _key& key) {
+        return mapped(try_emplace_key(key).first);
+    }
+
+    _value& operator[](_key&& key) {
+        return mapped(try_emplace_key(std::move(key)).first);
+    }
+
+    _value& at(const _key& key) {
+        const_iterator it = tree.find(key);
+        if (it == end()) {
+            const std::string err = __func__;
+            throw std::out_of_range(err + " received a key which is not contained in the map.");
+        }
+        return mapped(it);
+    }
+
+    const _value& at(const _key& key) const {
+        return const_cast<order_statistic_map*>(this)->at(key);
+    }
+
+    std::pair<const_iterator, bool> insert(const value_type& value) {
+        return tree.insert(value);
+    }
+
+    std::pair<const_iterator, bool> insert(value_type&& value) {
+        return tree.insert(std::move(value));
+    }
+
+    // the value is constructed only if key is not contained yet
+    template<class... Args>
+    std::pair<const_iterator, bool> try_emplace(const _key& key, Args&&... args) {
+        return try_emplace_key(key, std::forward<Args>(args)...);
+    }
+
+    template<class... Args>
+    std::pair<const_iterator, bool> try_emplace(_key&& key, Args&&... args) {
+        return try_emplace_key(std::move(key), std::forward<Args>(args)...);
+    }
+
+    // assigns value to key, returns whenever key was inserted
+    template<class V>
+    std::pair<const_iterator, bool> insert_or_assign(const _key& key, V&& value) {
+        std::pair<const_iterator, bool> res = try_emplace_key(key, std::forward<V>(value));
+        if (!res.second) mapped(res.first) = std::forward<V>(value);
+        return res;
+    }
+
+    void erase(const _key& key) {
+        tree.erase(key);
+    }
+
+    void erase(const const_iterator& it) {
+        tree.erase(it);
+    }
+
+    bool contains(const _key& key) const {
+        return tree.contains(key);
+    }
+
+    size_t count(const _key& key) const {
+        return tree.count(key);
+    }
+
+    const_iterator find(const _key& key) const {
+        return tree.find(key);
+    }
+
+    const_iterator lower_bound(const _key& key) const {
+        return tree.lower_bound(key);
+    }
+
+    const_iterator upper_bound(const _key& key) const {
+        return tree.upper_bound(key);
+    }
+
+    // returns the number of keys less than key
+    size_t order_of_key(const _key& key) const {
+        return tree.order_of_key(key);
+    }
+
+    // returns the number of keys in [lo, hi)
+    size_t count_range(const _key& lo, const _key& hi) const {
+        return compare()(lo, hi) ? tree.order_of_key(hi) - tree.order_of_key(lo) : 0;
+    }
+
+    // returns iterator to the pair with the k-th smallest key
+    const_iterator statistic(int k) const {
+        return tree.statistic(k);
+    }
+
+    // maps are equal if they contain equal keys with equal values
+    bool operator==(const order_statistic_map& rhs) const {
+        if (size() != rhs.size()) return false;
+        return std::equal(begin(), end(), rhs.begin(), [](const value_type& a, const value_type& b) {
+            return !(compare()(a.first, b.first) | compare()(b.first, a.first)) && a.second == b.second;
+        });
+    }
+
+    bool operator!=(const order_statistic_map& rhs) const {
+        return !(*this == rhs);
+    }
+};
+
+/*
+    Sequence with positions given by subtree sizes of the treap instead of compare (implicit keys), a rope.
+    Insertion and erasure at a position, access by position, concatenation and cutting out a subsequence
+    take O(log n). Values are not compared, so they are mutable through operator[] and at.
+*/
+template<typename _value, class Allocator = std::allocator<_value>>
+class order_statistic_sequence {
+private:
+    using tree_type = order_statistic_tree<_value, std::less<_value>, Allocator>;
+    using tree_node = typename tree_type::tree_node;
+    using node_pair = typename tree_type::node_pair;
+
+    tree_type tree;
+
+    explicit order_statistic_sequence(tree_type&& t) : tree(std::move(t)) {}
+
+    // splits the subtree into its first k values and the rest
+    static node_pair split_at(tree_node* v, size_t k) {
+        return tree_type::split_by(v, [&](tree_node* u) {
+            if (tree_type::size(u->l) >= k) return false;
+            k -= tree_type::size(u->l) + 1;
+            return true;
+        });
+    }
+
+    tree_node* node_at(size_t pos) const {
+        tree_node* v = tree.root;
+        while (pos != tree_type::size(v->l)) {
+            if (pos < tree_type::size(v->l)) {
+                v = v->l;
+            } else {
+                pos -= tree_type::size(v->l) + 1;
+                v = v->r;
+            }
+        }
+        return v;
+    }
+
+    void set_root(tree_node* v) {
+        tree.root = v;
+        tree.upd_end();
+    }
+
+    template<class... Args>
+    void emplace_node(size_t pos, Args&&... args) {
+        tree_node* nw = tree.get_pool().create(std::forward<Args>(args)...);
+        nw->prior = rand();
+        nw->update_node();
+
+        node_pair q = split_at(tree.root, pos);
+        set_root(tree_type::merge(tree_type::merge(q.first, nw), q.second));
+    }
+
+    void check_position(size_t pos, size_t bound, const char* func) const {
+        if (pos > bound) {
+            const std::string err = func;
+            throw std::out_of_range(err + " received a position out of the sequence.");
+        }
+    }
+public:
+    using value_type = _value;
+    using const_iterator = typename tree_type::const_iterator;
+    using const_reverse_iterator = typename tree_type::const_reverse_iterator;
+
+    explicit order_statistic_sequence(const Allocator& alloc = Allocator()) : tree(alloc) {}
+
+    // builds the sequence of values of the range in linear time
+    template<class InputIt>
+    order_statistic_sequence(InputIt first, InputIt last, const Allocator& alloc = Allocator()) : tree(alloc) {
+        typename tree_type::node_list nodes(alloc);
+        for (; first != last; ++first) {
+            nodes.push_back(tree.get_pool().create(*first));
+            nodes.back()->prior = rand();
+        }
+        set_root(tree_type::build(nodes.begin(), nodes.end()));
+    }
+
+    order_statistic_sequence(std::initializer_list<_value> init, const Allocator& alloc = Allocator())
+        : order_statistic_sequence(init.begin(), init.end(), alloc) {}
+
+    Allocator get_allocator() const {
+        return tree.get_allocator();
+    }
+
+    [[nodiscard]] bool empty() const {
+        return tree.empty();
+    }
+
+    [[nodiscard]] size_t size() const {
+        return tree.size();
+    }
+
+    void clear() {
+        tree.clear();
+    }
+
+    void swap(order_statistic_sequence& other) {
+        tree.swap(other.tree);
+    }
+
+    const_iterator begin() const {
+        return tree.begin();
+    }
+
+    const_iterator end() const {
+        return tree.end();
+    }
+
+    const_reverse_iterator rbegin() const {
+        return tree.rbegin();
+    }
+
+    const_reverse_iterator rend() const {
+        return tree.rend();
+    }
+
+    _value& operator[](size_t pos) {
+        return node_at(pos)->key;
+    }
+
+    const _value& operator[](size_t pos) const {
+        return node_at(pos)->key;
+    }
+
+    _value& at(size_t pos) {
+        check_position(pos + 1, size(), __func__);
+        return node_at(pos)->key;
+    }
+
+    const _value& at(size_t pos) const {
+        check_position(pos + 1, size(), __func__);
+        return node_at(pos)->key;
+    }
+
+    // inserts value before position pos, pos may be equal to size()
+    void insert_at(size_t pos, const _value& value) {
+        check_position(pos, size(), __func__);
+        emplace_node(pos, value);
+    }
+
+    void insert_at(size_t pos, _value&& value) {
+        check_position(pos, size(), __func__);
+        emplace_node(pos, std::move(value));
+    }
+
+    void push_back(const _value& value) {
+        emplace_node(size(), value);
+    }
+
+    void push_back(_value&& value) {
+        emplace_node(size(), std::move(value));
+    }
+
+    void erase_at(size_t pos) {
+        check_position(pos + 1, size(), __func__);
+        node_pair q = split_at(tree.root, pos);
+        node_pair q2 = split_at(q.second, 1);
+        tree.get_pool().destroy(q2.first);
+        set_root(tree_type::merge(q.first, q2.second));
+    }
+
+    // appends all values of other in O(log n), other is left empty
+    void concat(order_statistic_sequence&& other) {
+        if (this == &other) return;
+        tree_node* v = tree.adopt(other.tree);
+        set_root(tree_type::merge(tree.root, v));
     }
 
-    [[nodiscard]] size_t size() const {
-        return root ? root->size : 0;
+    /*
+        Removes len values starting from position pos and returns them as a sequence in O(log n).
+        The returned sequence shares the node pool with this one, so they must not be modified concurrently.
+    */
+    order_statistic_sequence cut(size_t pos, size_t len) {
+        check_position(pos, size(), __func__);
+        node_pair q = split_at(tree.root, pos);
+        node_pair q2 = split_at(q.second, len);
+        set_root(tree_type::merge(q.first, q2.second));
+        return order_statistic_sequence(tree_type(tree.pool, q2.first));
     }
 
-    tree_node* get_root() const {
-        return root;
+    bool operator==(const order_statistic_sequence& rhs) const {
+        return size() == rhs.size() && std::equal(begin(), end(), rhs.begin());
     }
-    tree_node* get_end_node() const {
-        return endnode;
+
+    bool operator!=(const order_statistic_sequence& rhs) const {
+        return !(*this == rhs);
     }
+};
 
-    void change_root(tree_node* rt) {
-        root = rt;
+/*
+    Memory compact variant of order_statistic_tree.
+    Nodes live in contiguous arrays addressed by 32-bit indices with keys, children and subtree sizes
+    kept in separate arrays, priorities are derived from node indices and there are no parent links.
+    For int keys a node takes 16 bytes instead of 40. Iterators are rank based.
+*/
+template<typename _key, class compare = std::less<_key>, class Allocator = std::allocator<_key>>
+class compact_order_statistic_tree {
+private:
+    using index = uint32_t;
+    using index_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<index>;
+
+    // index 0 stands for the empty subtree
+    static constexpr index nil = 0;
+
+    std::vector<_key, Allocator> keys;
+    std::vector<index, index_allocator> lc, rc, sz;
+    std::vector<index, index_allocator> path;
+    index root = nil, free_list = nil;
+
+    // pseudo random priority of the node, a max-heap is maintained on it
+    static uint32_t prior(index v) {
+        uint32_t x = v * 0x9E3779B9u;
+        x ^= x >> 16;
+        x *= 0x85EBCA6Bu;
+        x ^= x >> 13;
+        x *= 0xC2B2AE35u;
+        x ^= x >> 16;
+        return x;
     }
 
-    void change_end_node(tree_node* nd) {
-        endnode = nd;
+    void update_node(index v) {
+        sz[v] = sz[lc[v]] + sz[rc[v]] + 1;
     }
 
-    void swap(order_statistic_tree<_key>& rt) {
-        std::swap(root, rt.root);
-        std::swap(endnode, rt.endnode);
+    index create(const _key& k) {
+        index v = free_list;
+        if (v != nil) {
+            free_list = lc[v];
+            keys[v] = k;
+        } else {
+            v = index(keys.size());
+            keys.push_back(k);
+            lc.push_back(nil);
+            rc.push_back(nil);
+            sz.push_back(0);
+        }
+        lc[v] = rc[v] = nil;
+        sz[v] = 1;
+        return v;
     }
 
-    // clears the tree and used memory
-    void clear() {
-        delete root;
+    void destroy(index v) {
+        keys[v] = _key();
+        lc[v] = free_list;
+        free_list = v;
+    }
 
-        root = nullptr;
-        upd_end();
+    // recomputes sizes of nodes stored in path starting from position from, deepest node last
+    void fix_path(size_t from) {
+        while (path.size() > from) {
+            update_node(path.back());
+            path.pop_back();
+        }
     }
 
-    ~order_statistic_tree() {
-        delete root;
-        endnode->l = 0;
-        endnode->r = 0;
-        delete endnode;
+    // splits the subtree v into keys less than value (written to *l) and the rest (written to *r)
+    void split(index v, const _key& value, index* l, index* r) {
+        size_t from = path.size();
+        while (v != nil) {
+            path.push_back(v);
+            if (compare()(keys[v], value)) {
+                *l = v;
+                l = &rc[v];
+                v = rc[v];
+            } else {
+                *r = v;
+                r = &lc[v];
+                v = lc[v];
+            }
+        }
+        *l = *r = nil;
+        fix_path(from);
     }
 
-    // checks whenever value is contained in the tree
-    bool contains(_key value) const {
-        if (!root) return 0;
+    // merges subtrees l and r, all keys in l are smaller than keys in r
+    index merge(index l, index r) {
+        size_t from = path.size();
+        index res = nil;
+        index* hook = &res;
+        while (l != nil && r != nil) {
+            if (prior(l) > prior(r)) {
+                path.push_back(l);
+                *hook = l;
+                hook = &rc[l];
+                l = rc[l];
+            } else {
+                path.push_back(r);
+                *hook = r;
+                hook = &lc[r];
+                r = lc[r];
+            }
+        }
+        *hook = (l != nil ? l : r);
+        fix_path(from);
+        return res;
+    }
 
-        _key k = find(root, value)->key;
-        return !(compare()(k, value) | compare()(value, k));
+    // returns the node with the smallest key which is not less than value (strict = false)
+    // or greater than value (strict = true), nil if there is no such node
+    index bound(const _key& value, bool strict, size_t& rank) const {
+        index v = root, res = nil;
+        size_t cur = 0;
+        rank = size();
+        while (v != nil) {
+            bool go_right = strict ? !compare()(value, keys[v]) : compare()(keys[v], value);
+            if (go_right) {
+                cur += sz[lc[v]] + 1;
+                v = rc[v];
+            } else {
+                res = v;
+                rank = cur + sz[lc[v]];
+                v = lc[v];
+            }
+        }
+        return res;
     }
 
-    void insert(_key value) {
-        if (contains(value)) return;
-        root = insert(root, value);
+    index stat(size_t k) const {
+        index v = root;
+        while (true) {
+            if (k < sz[lc[v]]) {
+                v = lc[v];
+            } else if (k == sz[lc[v]]) {
+                return v;
+            } else {
+                k -= sz[lc[v]] + 1;
+                v = rc[v];
+            }
+        }
+    }
 
-        upd_end();
+public:
+    explicit compact_order_statistic_tree(const Allocator& alloc = Allocator())
+        : keys(alloc), lc(alloc), rc(alloc), sz(alloc), path(alloc) {
+        clear();
     }
 
-    template<bool isReversed>
-    class BaseIterator {
+    class const_iterator {
     private:
-        tree_node* ptr, * endnode;
+        const compact_order_statistic_tree* tree;
+        size_t rank;
     public:
         using iterator_category = std::random_access_iterator_tag;
         using value_type = _key;
-        using reference = _key&;
-        using pointer = _key*;
+        using reference = const _key&;
+        using pointer = const _key*;
         using difference_type = std::ptrdiff_t;
 
-        explicit BaseIterator(tree_node* ptr, tree_node* endnode) : ptr(ptr), endnode(endnode) {}
+        const_iterator(const compact_order_statistic_tree* tree = nullptr, size_t rank = 0) : tree(tree), rank(rank) {}
 
-        template<bool isReversedOther>
-        explicit BaseIterator(const BaseIterator<isReversedOther>& other) : ptr(other.getPtr()), endnode(other.endnode) {}
+        const _key& operator*() const {
+            return tree->keys[tree->stat(rank)];
+        }
 
-        // returns index of value in set if value exists
-        int get_index(tree_node* v) const {
-            if (v == endnode) return size(v->l);
-            int ind = size(v->l);
-            while (v->par) {
-                if (v->par->r == v) {
-                    ind += size(v->par->l) + 1;
-                }
+        const _key& operator[](difference_type n) const {
+            return *(*this + n);
+        }
 
-                v = v->par;
-            }
+        const_iterator& operator++() { ++rank; return *this; }
+        const_iterator& operator--() { --rank; return *this; }
+        const_iterator operator++(int) { const_iterator ans = *this; ++rank; return ans; }
+        const_iterator operator--(int) { const_iterator ans = *this; --rank; return ans; }
+        const_iterator& operator+=(difference_type add) { rank += add; return *this; }
+        const_iterator& operator-=(difference_type add) { rank -= add; return *this; }
+        const_iterator operator+(difference_type add) const { return const_iterator(tree, rank + add); }
+        const_iterator operator-(difference_type add) const { return const_iterator(tree, rank - add); }
+
+        difference_type operator-(const const_iterator& other) const {
+            return difference_type(rank) - difference_type(other.rank);
+        }
 
-            return ind;
+        bool operator==(const const_iterator& other) const { return rank == other.rank; }
+        bool operator!=(const const_iterator& other) const { return rank != other.rank; }
+        bool operator<(const const_iterator& other) const { return rank < other.rank; }
+        bool operator>(const const_iterator& other) const { return rank > other.rank; }
+        bool operator<=(const const_iterator& other) const { return rank <= other.rank; }
+        bool operator>=(const const_iterator& other) const { return rank >= other.rank; }
+
+        size_t get_index() const {
+            return rank;
         }
+    };
 
-        tree_node* next(tree_node* v) const {
-            if (v->r) {
-                v = v->r;
-                while (v->l) v = v->l;
-                return v;
-            }
+    using iterator = const_iterator;
 
-            tree_node* pr = v;
-            while (v->l != pr) {
-                if (!v->par) return nullptr;
-                pr = v;
-                v = v->par;
-            }
+    [[nodiscard]] bool empty() const {
+        return root == nil;
+    }
 
-            return v;
-        }
+    [[nodiscard]] size_t size() const {
+        return sz[root];
+    }
 
-        tree_node* prev(tree_node* v) const {
-            if (v->l) {
-                v = v->l;
-                while (v->r) v = v->r;
-                return v;
-            }
+    // reserves memory for n keys
+    void reserve(size_t n) {
+        keys.reserve(n + 1);
+        lc.reserve(n + 1);
+        rc.reserve(n + 1);
+        sz.reserve(n + 1);
+    }
 
-            tree_node* pr = v;
-            while (v->r != pr) {
-                if (!v->par) return nullptr;
-                pr = v;
-                v = v->par;
-            }
+    void clear() {
+        keys.assign(1, _key());
+        lc.assign(1, nil);
+        rc.assign(1, nil);
+        sz.assign(1, 0);
+        root = free_list = nil;
+    }
 
-            return v;
-        }
+    void swap(compact_order_statistic_tree& rt) {
+        keys.swap(rt.keys);
+        lc.swap(rt.lc);
+        rc.swap(rt.rc);
+        sz.swap(rt.sz);
+        std::swap(root, rt.root);
+        std::swap(free_list, rt.free_list);
+    }
 
-        void descendLeft() {
-            while (ptr->l) ptr = ptr->l;
-        }
+    bool contains(const _key& value) const {
+        size_t rank;
+        index v = bound(value, false, rank);
+        return v != nil && !compare()(value, keys[v]);
+    }
 
-        void descendRight() {
-            while (ptr->r) ptr = ptr->r;
+    /*
+        Inserts value if it is not contained yet, returns whenever the insertion took place.
+        The descent looks for value and for the place of the new node at once, sizes on the way
+        are fixed only if the insertion takes place.
+    */
+    bool insert(const _key& value) {
+        // the new node gets the index create() returns, its priority is known before the descent
+        index nw = free_list != nil ? free_list : index(keys.size());
+        index v = root;
+        while (v != nil && prior(v) > prior(nw)) {
+            if (compare()(value, keys[v])) {
+                path.push_back(v);
+                v = lc[v];
+            } else if (compare()(keys[v], value)) {
+                path.push_back(v);
+                v = rc[v];
+            } else {
+                path.clear();
+                return false;
+            }
         }
-
-        BaseIterator& operator = (const BaseIterator& other) {
-            ptr = other.ptr;
-            endnode = other.endnode;
-            return *this;
+        for (index u = v; u != nil; ) {
+            if (compare()(value, keys[u])) u = lc[u];
+            else if (compare()(keys[u], value)) u = rc[u];
+            else {
+                path.clear();
+                return false;
+            }
         }
 
-        int operator - (const BaseIterator& other) const {
-            tree_node* root = this->endnode->l;
-            int lst = root ? root->size : 0;
-            if (ptr != endnode) lst = get_index(ptr);
-            int fst = lst;
-            tree_node* root2 = other.endnode->l;
-            if (other.ptr != endnode) fst = get_index(other.ptr);
+        // create may reallocate the links, so the parent is kept instead of a pointer
+        create(value);
+        for (index u : path) ++sz[u];
+        index par = path.empty() ? nil : path.back();
+        path.clear();
+
+        split(v, value, &lc[nw], &rc[nw]);
+        update_node(nw);
+        if (par == nil) root = nw;
+        else if (compare()(value, keys[par])) lc[par] = nw;
+        else rc[par] = nw;
+        return true;
+    }
 
-            return lst - fst;
+    // erases value if it is contained, returns whenever the erasure took place
+    bool erase(const _key& value) {
+        index* link = &root;
+        while (*link != nil) {
+            index v = *link;
+            if (compare()(value, keys[v])) link = &lc[v];
+            else if (compare()(keys[v], value)) link = &rc[v];
+            else break;
+            path.push_back(v);
         }
 
-        BaseIterator& operator+=(int add) {
-            if (isReversed) add = -add;
-            int cur = size(endnode->r);
-            if (ptr != endnode) cur = get_index(ptr);
-
-            int nd = add + cur;
-            if (nd < 0 || nd >= size(endnode->r)) nd = size(endnode->r);
+        if (*link == nil) {
+            path.clear();
+            return false;
+        }
+        for (index u : path) --sz[u];
+        path.clear();
 
-            auto it = endnode->r;
+        index v = *link;
+        *link = merge(lc[v], rc[v]);
+        destroy(v);
+        return true;
+    }
 
-            ptr = stat(nd);
+    const_iterator begin() const {
+        return const_iterator(this, 0);
+    }
 
-            return *this;
-        }
+    const_iterator end() const {
+        return const_iterator(this, size());
+    }
 
-        BaseIterator& operator+(int add) {
-            if (isReversed) add = -add;
-            int cur = size(endnode->r);
-            if (ptr != endnode) cur = get_index(ptr);
+    const_iterator find(const _key& value) const {
+        size_t rank;
+        index v = bound(value, false, rank);
+        if (v == nil || compare()(value, keys[v])) return end();
+        return const_iterator(this, rank);
+    }
 
-            int nd = add + cur;
-            if (nd < 0 || nd >= size(endnode->r)) nd = size(endnode->r);
+    const_iterator lower_bound(const _key& value) const {
+        size_t rank;
+        bound(value, false, rank);
+        return const_iterator(this, rank);
+    }
 
-            auto it = endnode->r;
+    const_iterator upper_bound(const _key& value) const {
+        size_t rank;
+        bound(value, true, rank);
+        return const_iterator(this, rank);
+    }
 
-            return BaseIterator<isReversed>(stat(nd), endnode);
-        }
+    // ordered statistic implementation
+    const_iterator statistic(size_t k) const {
+        return const_iterator(this, std::min(k, size()));
+    }
 
-        BaseIterator& operator-(int add) {
-            if (isReversed) add = -add;
-            int cur = size(endnode->r);
-            if (ptr != endnode) cur = get_index(ptr);
+    // returns the number of keys less than value
+    size_t order_of_key(const _key& value) const {
+        size_t rank;
+        bound(value, false, rank);
+        return rank;
+    }
 
-            int nd = add + cur;
-            if (nd < 0 || nd >= size(endnode->r)) nd = size(endnode->r);
+    // returns the number of keys in [lo, hi)
+    size_t count_range(const _key& lo, const _key& hi) const {
+        return compare()(lo, hi) ? order_of_key(hi) - order_of_key(lo) : 0;
+    }
+};
 
-            auto it = endnode->r;
+/*
+    Immutable snapshot of an order statistic tree for read-mostly workloads, made by freeze().
+    Distinct keys are stored in one array in Eytzinger (breadth-first) order of a complete search tree,
+    every slot keeps the number of keys before it and the number of copies of its key inline.
+    The top levels of the tree share a few cache lines, a search takes only index arithmetic and prefetches
+    the descendants a few levels ahead. Iterators are slot based, moves by n use a rank descent.
+*/
+template<typename _key, class compare = std::less<_key>, class Allocator = std::allocator<_key>>
+class frozen_order_statistic_tree {
+private:
+    template<typename, class, class, bool, class, bool>
+    friend class order_statistic_tree;
 
-            return BaseIterator<isReversed>(stat(nd), endnode);
-        }
+    struct slot {
+        _key key;
+        int cnt;
+        // number of keys before this one, copies included
+        size_t rank;
+    };
+    using slot_allocator = typename std::allocator_traits<Allocator>::template rebind_alloc<slot>;
+    using slot_list = std::vector<slot, slot_allocator>;
 
-        BaseIterator& operator-=(int add) {
-            if (isReversed) add = -add;
-            int cur = size(endnode->r);
-            if (ptr != endnode) cur = get_index(ptr);
+    // slots[1..n] hold the tree, the children of slot i are 2i and 2i + 1, slot 0 stands for the end
+    slot_list slots;
+    size_t total = 0;
 
-            int nd = cur - add;
-            if (nd < 0 || nd >= size(endnode->r)) nd = size(endnode->r);
+    size_t slot_count() const {
+        return slots.size() - 1;
+    }
 
-            auto it = endnode->r;
+    // the descendants of slot i that many levels down are adjacent and fill about a cache line
+    static constexpr size_t prefetch_levels = sizeof(slot) <= 8 ? 3 : sizeof(slot) <= 16 ? 2 : 1;
 
-            ptr = stat(nd);
+    static void prefetch(const slot* v) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(v);
+#endif
+    }
 
-            return *this;
-        }
+    // takes distinct keys in key order with their counts, made by order_statistic_tree::freeze
+    explicit frozen_order_statistic_tree(slot_list&& sorted) : slots(sorted.get_allocator()) {
+        build(sorted);
+    }
 
-        void changePtr(tree_node* t) {
-            ptr = t;
+    // computes the ranks of the sorted keys and lays them out
+    void build(slot_list& sorted) {
+        for (slot& v : sorted) {
+            v.rank = total;
+            total += v.cnt;
         }
 
-        // ordered statistic implementation
-        tree_node* stat(int nd) const {
-            if (nd >= size(endnode->r)) return endnode;
-            ++nd;
+        slots.resize(sorted.size() + 1);
+        auto it = sorted.begin();
+        fill(1, it);
+    }
 
-            tree_node* v = endnode->r;
-            while (nd != 0) {
-                if (size(v->l) + 1 < nd) {
-                    nd -= size(v->l) + 1;
-                    v = v->r;
-                } else if (size(v->l) + 1 == nd) {
-                    nd = 0;
-                } else {
-                    v = v->l;
-                }
-            }
+    // places sorted keys with their counts to the slots of the subtree i in key order
+    template<class It>
+    void fill(size_t i, It& it) {
+        if (i > slot_count()) return;
+        fill(2 * i, it);
+        slots[i] = *it++;
+        fill(2 * i + 1, it);
+    }
 
-            return v;
+    /*
+        Returns the slot with the smallest key which is not less than value (strict = false)
+        or greater than value (strict = true), 0 if there is no such slot.
+        The descent takes one comparison per level and no branches on its result. Below the answer
+        it turns left once and then goes only right, so the answer is i without its trailing ones and one more bit.
+    */
+    template<class K>
+    size_t bound(const K& value, bool strict) const {
+        size_t i = 1, n = slot_count();
+        while (i <= n) {
+            if ((i << prefetch_levels) <= n) prefetch(&slots[i << prefetch_levels]);
+            bool go_right = strict ? !compare()(value, slots[i].key) : compare()(slots[i].key, value);
+            i = 2 * i + go_right;
         }
+        while (i & 1) i >>= 1;
+        return i >> 1;
+    }
 
-        BaseIterator& operator++() {
-            if (ptr == endnode) {
-                if (!isReversed) {
-                    descendLeft();
-                } else {
-                    descendRight();
-                }
+    // returns the slot holding the key with rank k and the position among its copies
+    std::pair<size_t, int> stat(size_t k) const {
+        size_t i = 1, n = slot_count();
+        while (i <= n) {
+            if (k < slots[i].rank) i = 2 * i;
+            else if (k < slots[i].rank + slots[i].cnt) return { i, int(k - slots[i].rank) };
+            else i = 2 * i + 1;
+        }
+        return { 0, 0 };
+    }
 
-                if (ptr == nullptr) ptr = endnode;
-                return *this;
-            }
-            if (!isReversed)
-                ptr = next(ptr);
-            else
-                ptr = prev(ptr);
+    // in-order neighbours of slot i, 0 after the last and before the first slot
+    size_t next(size_t i) const {
+        size_t n = slot_count();
+        if (i == 0) {
+            i = n ? 1 : 0;
+            while (i && 2 * i <= n) i *= 2;
+            return i;
+        }
+        if (2 * i + 1 <= n) {
+            for (i = 2 * i + 1; 2 * i <= n; i *= 2) {}
+            return i;
+        }
+        while (i & 1) i >>= 1;
+        return i >> 1;
+    }
 
-            if (ptr == nullptr) ptr = endnode;
+    size_t prev(size_t i) const {
+        size_t n = slot_count();
+        if (i == 0) {
+            i = n ? 1 : 0;
+            while (i && 2 * i + 1 <= n) i = 2 * i + 1;
+            return i;
+        }
+        if (2 * i <= n) {
+            for (i = 2 * i; 2 * i + 1 <= n; i = 2 * i + 1) {}
+            return i;
+        }
+        while (i > 1 && !(i & 1)) i >>= 1;
+        return i >> 1;
+    }
 
-            return *this;
+public:
+    // keys of the range are sorted if needed, equal keys are kept as copies of one key
+    template<class InputIt>
+    frozen_order_statistic_tree(InputIt first, InputIt last, const Allocator& alloc = Allocator()) : slots(slot_allocator(alloc)) {
+        slot_list sorted{ slot_allocator(alloc) };
+        bool is_sorted = true;
+        for (; first != last; ++first) {
+            if (!sorted.empty() && compare()(*first, sorted.back().key)) is_sorted = false;
+            sorted.push_back({ *first, 1, 0 });
+        }
+        if (!is_sorted) std::stable_sort(sorted.begin(), sorted.end(), [](const slot& a, const slot& b) {
+            return compare()(a.key, b.key);
+        });
+
+        size_t cnt = 0;
+        for (const slot& v : sorted) {
+            if (cnt && !compare()(sorted[cnt - 1].key, v.key)) {
+                ++sorted[cnt - 1].cnt;
+            } else {
+                sorted[cnt++] = v;
+            }
         }
+        sorted.erase(sorted.begin() + cnt, sorted.end());
+        build(sorted);
+    }
 
-        BaseIterator& operator--() {
-            if (ptr == endnode) {
-                if (isReversed) {
-                    descendLeft();
-                } else {
-                    descendRight();
-                }
+    explicit frozen_order_statistic_tree(const Allocator& alloc = Allocator()) : slots(1, slot(), slot_allocator(alloc)) {}
 
-                if (ptr == nullptr) ptr = endnode;
-                return *this;
-            }
+    class const_iterator {
+    private:
+        const frozen_order_statistic_tree* tree;
+        size_t i;
+        // position among the copies of the key
+        int rep;
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = _key;
+        using reference = const _key&;
+        using pointer = const _key*;
+        using difference_type = std::ptrdiff_t;
 
-            if (!isReversed)
-                ptr = prev(ptr);
-            else
-                ptr = next(ptr);
+        const_iterator(const frozen_order_statistic_tree* tree = nullptr, size_t i = 0, int rep = 0) : tree(tree), i(i), rep(rep) {}
 
-            if (ptr == nullptr) ptr = endnode;
+        // rank of the key, size() for the end
+        size_t get_index() const {
+            return i ? tree->slots[i].rank + rep : tree->total;
+        }
 
-            return *this;
+        const _key& operator*() const {
+            return tree->slots[i].key;
         }
 
-        BaseIterator operator++(int) {
-            BaseIterator ans = *this;
-            ++(*this);
-            return ans;
+        const _key* operator->() const {
+            return &tree->slots[i].key;
         }
 
-        BaseIterator operator--(int) {
-            BaseIterator ans = *this;
-            --(*this);
-            return ans;
+        const _key& operator[](difference_type n) const {
+            return *(*this + n);
         }
 
-        bool operator == (const BaseIterator<isReversed>& other) const {
-            return ptr == other.getPtr();
+        const_iterator& operator++() {
+            if (i && rep + 1 < tree->slots[i].cnt) {
+                ++rep;
+            } else {
+                i = tree->next(i);
+                rep = 0;
+            }
+            return *this;
         }
 
-        bool operator != (const BaseIterator<isReversed>& other) const {
-            return ptr != other.getPtr();
+        const_iterator& operator--() {
+            if (i && rep > 0) {
+                --rep;
+            } else {
+                i = tree->prev(i);
+                rep = i ? tree->slots[i].cnt - 1 : 0;
+            }
+            return *this;
         }
 
-        _key operator* () const {
-            return ptr->key;
+        const_iterator operator++(int) { const_iterator ans = *this; ++*this; return ans; }
+        const_iterator operator--(int) { const_iterator ans = *this; --*this; return ans; }
+        const_iterator& operator+=(difference_type add) { return *this = tree->statistic(get_index() + add); }
+        const_iterator& operator-=(difference_type add) { return *this = tree->statistic(get_index() - add); }
+        const_iterator operator+(difference_type add) const { return tree->statistic(get_index() + add); }
+        const_iterator operator-(difference_type add) const { return tree->statistic(get_index() - add); }
+
+        friend const_iterator operator+(difference_type add, const const_iterator& it) {
+            return it + add;
         }
 
-        tree_node* getPtr() const {
-            return ptr;
+        difference_type operator-(const const_iterator& other) const {
+            return difference_type(get_index()) - difference_type(other.get_index());
         }
+
+        bool operator==(const const_iterator& other) const { return i == other.i && rep == other.rep; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+        bool operator<(const const_iterator& other) const { return get_index() < other.get_index(); }
+        bool operator>(const const_iterator& other) const { return other < *this; }
+        bool operator<=(const const_iterator& other) const { return !(other < *this); }
+        bool operator>=(const const_iterator& other) const { return !(*this < other); }
     };
 
-    using const_iterator = BaseIterator<false>;
-    using const_reverse_iterator = BaseIterator<true>;
-    using iterator = BaseIterator<0>;
-    using reverse_iterator = BaseIterator<1>;
+    using iterator = const_iterator;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+    using reverse_iterator = const_reverse_iterator;
 
-    // returns pointer to the smallest element in set
-    tree_node* first(tree_node* v) const {
-        if (!v) return nullptr;
-        while (v->l) v = v->l;
-        return v;
+    Allocator get_allocator() const {
+        return Allocator(slots.get_allocator());
     }
 
-    // returns pointer to the largest element in set
-    tree_node* last(tree_node* v) const {
-        if (!v) return nullptr;
-        while (v->r) v = v->r;
-        return v;
+    [[nodiscard]] bool empty() const {
+        return total == 0;
     }
 
-    const_iterator begin() const {
-        return iterator((root ? first(root) : endnode), endnode);
+    [[nodiscard]] size_t size() const {
+        return total;
     }
 
-    const_reverse_iterator rbegin() const {
-        return reverse_iterator((root ? last(root) : endnode), endnode);
+    void swap(frozen_order_statistic_tree& rt) {
+        slots.swap(rt.slots);
+        std::swap(total, rt.total);
+    }
+
+    const_iterator begin() const {
+        return const_iterator(this, next(0));
     }
 
     const_iterator end() const {
-        return iterator(endnode, endnode);
+        return const_iterator(this, 0);
+    }
+
+    const_reverse_iterator rbegin() const {
+        return const_reverse_iterator(end());
     }
 
     const_reverse_iterator rend() const {
-        return reverse_iterator(endnode, endnode);
+        return const_reverse_iterator(begin());
     }
 
-    bool operator==(const order_statistic_tree& rhs) const {
-        return rhs.root = root;
+    bool contains(const _key& value) const {
+        size_t i = bound(value, false);
+        return i && !compare()(value, slots[i].key);
     }
 
-    const_iterator find(_key value) const {
-        if (root == nullptr) return end();
-        tree_node* v = find(root, value);
-        if (!(compare()(v->key, value) | compare()(value, v->key))) return iterator(v, endnode);
-        return end();
+    const_iterator find(const _key& value) const {
+        size_t i = bound(value, false);
+        return i && !compare()(value, slots[i].key) ? const_iterator(this, i) : end();
     }
 
-    void erase(_key a) {
-        node_pair q = split(root, a);
-        node_pair q2 = spliteq(q.second, a);
-        root = merge(q.first, q2.second);
+    size_t count(const _key& value) const {
+        size_t i = bound(value, false);
+        return i && !compare()(value, slots[i].key) ? slots[i].cnt : 0;
+    }
 
-        upd_end();
+    const_iterator lower_bound(const _key& value) const {
+        return const_iterator(this, bound(value, false));
     }
 
-    void erase(const const_iterator& a) {
-        if (a.getPtr() == nullptr) {
-            const std::string err = __func__;
-            throw std::invalid_argument(err + " received iterator to an empty node.");
-        }
-        erase(a.getPtr()->key);
+    const_iterator upper_bound(const _key& value) const {
+        return const_iterator(this, bound(value, true));
     }
 
-    const_iterator lower_bound(_key a) const {
-        const_iterator v = iterator(find(root, a), endnode);
-        if (v != end() && compare()((*v), a)) {
-            v++;
-        }
-        return v;
+    // ordered statistic implementation, ranks out of [0, size()) give end()
+    const_iterator statistic(size_t k) const {
+        std::pair<size_t, int> res = stat(k);
+        return const_iterator(this, res.first, res.second);
     }
 
-    const_iterator upper_bound(_key a) const {
-        const_iterator v = iterator(find(root, a), endnode);
-        if (v != end() && (!compare()(a, *v))) {
-            v++;
-        }
-        return v;
+    // returns the number of keys less than value
+    size_t order_of_key(const _key& value) const {
+        size_t i = bound(value, false);
+        return i ? slots[i].rank : total;
     }
 
-    // ordered statistic implementation
-    const_iterator statistic(int k) const {
-        if (k >= size()) return end();
+    // returns the number of keys in [lo, hi)
+    size_t count_range(const _key& lo, const _key& hi) const {
+        return compare()(lo, hi) ? order_of_key(hi) - order_of_key(lo) : 0;
+    }
 
-        const_iterator v = const_iterator(endnode, endnode);
-        v.changePtr(v.stat(k));
-        return v;
+    bool operator==(const frozen_order_statistic_tree& rhs) const {
+        return size() == rhs.size() && std::equal(begin(), end(), rhs.begin());
+    }
+
+    bool operator!=(const frozen_order_statistic_tree& rhs) const {
+        return !(*this == rhs);
     }
 };
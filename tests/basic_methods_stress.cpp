@@ -1,11 +1,53 @@
 #include <iostream>
 #include <set>
+#include <map>
 #include <iomanip>
+#include <memory_resource>
+#include <string_view>
+#include <numeric>
+#include <climits>
+#include <thread>
+#include <random>
+#include <atomic>
+#include <cstdlib>
 #include "order_statistic_tree.h"
 using namespace std;
 
 const long long K = 1500, SQ = 1000;
 
+// calls of the global operator new, plain and aligned, allocator_test checks that trees over a pmr buffer do not use the heap.
+// operator delete is not inlined, otherwise gcc takes free() for a mismatch with the builtin operator new
+atomic<size_t> heap_allocations = 0;
+
+void* operator new(size_t n) {
+    ++heap_allocations;
+    if (void* p = malloc(n ? n : 1)) return p;
+    throw bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* p) noexcept {
+    free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+void* operator new(size_t n, align_val_t al) {
+    ++heap_allocations;
+    size_t align = size_t(al);
+    if (void* p = aligned_alloc(align, (max<size_t>(n, 1) + align - 1) / align * align)) return p;
+    throw bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* p, align_val_t) noexcept {
+    free(p);
+}
+
+[[gnu::noinline]] void operator delete(void* p, size_t, align_val_t) noexcept {
+    free(p);
+}
+
 void result(string func, bool res, vector<pair<int, string>> failed) {
     if (res) {
         cout << func << " passed all tests.";
@@ -158,6 +200,187 @@ void insert_test() {
         failed.push_back({ 4, "re" });
     }
 
+    // test5
+    try {
+        set<int> st1;
+        order_statistic_tree<int> st2;
+
+        vector<pair<int, bool>> vec1, vec2;
+        for (int i = 0; i < K; i++) {
+            int q = ext_rand() % K;
+            auto res1 = st1.insert(q);
+            auto res2 = st2.insert(q);
+            vec1.push_back({ *res1.first, res1.second });
+            vec2.push_back({ *res2.first, res2.second });
+            if (res2.first != st2.find(q)) failed.push_back({ 5, "wa" });
+        }
+
+        if (vec1 != vec2) failed.push_back({ 5, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 5, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void heterogeneous_lookup_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        set<string, less<>> st1;
+        order_statistic_tree<string, less<>> st2;
+
+        for (int i = 0; i < K; i++) {
+            string ins;
+            for (int j = 0; j < rand() % 3 + 1; j++) {
+                ins.push_back(rand() % 26 + 'a');
+            }
+            st1.insert(ins);
+            if (i % 2) st2.insert(std::move(ins));
+            else st2.emplace(ins.begin(), ins.end());
+        }
+
+        vector<string> vec1, vec2;
+        for (int i = 0; i < K; i++) {
+            string ins;
+            for (int j = 0; j < rand() % 3 + 1; j++) {
+                ins.push_back(rand() % 26 + 'a');
+            }
+            string_view q = ins;
+
+            vec1.push_back(st1.lower_bound(q) == st1.end() ? "#" : *st1.lower_bound(q));
+            vec2.push_back(st2.lower_bound(q) == st2.end() ? "#" : *st2.lower_bound(q));
+            vec1.push_back(st1.upper_bound(q) == st1.end() ? "#" : *st1.upper_bound(q));
+            vec2.push_back(st2.upper_bound(q) == st2.end() ? "#" : *st2.upper_bound(q));
+            vec1.push_back(st1.find(q) == st1.end() ? "#" : *st1.find(q));
+            vec2.push_back(st2.find(q) == st2.end() ? "#" : *st2.find(q));
+            vec1.push_back(to_string(st1.count(q)));
+            vec2.push_back(to_string(st2.contains(q)));
+
+            if (i % 2) {
+                if (st1.find(q) != st1.end()) st1.erase(st1.find(q));
+                st2.erase(q);
+            }
+        }
+
+        for (const auto& c : st1) vec1.push_back(c);
+        for (const auto& c : st2) vec2.push_back(c);
+
+        if (vec1 != vec2) failed.push_back({ 1, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void bulk_build_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        vector<int> vec;
+        for (int i = 0; i < K; i++) vec.push_back(ext_rand() % K);
+        set<int> st1(vec.begin(), vec.end());
+        vector<int> sorted(st1.begin(), st1.end());
+
+        order_statistic_tree<int> st2(sorted.begin(), sorted.end());
+        order_statistic_tree<int> st3(vec.begin(), vec.end());
+
+        vector<int> vec2, vec3;
+        for (auto c : st2) vec2.push_back(c);
+        for (int i = 0; i < st3.size(); i++) vec3.push_back(*st3.statistic(i));
+
+        if (vec2 != sorted || vec3 != sorted) failed.push_back({ 1, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        set<string> st1;
+        order_statistic_tree<string> st2 = { "c", "a", "b", "a" };
+
+        vector<string> ins;
+        for (int i = 0; i < K; i++) {
+            string cur;
+            for (int j = 0; j < rand() % 3 + 1; j++) {
+                cur.push_back(rand() % 26 + 'a');
+            }
+            ins.push_back(cur);
+            st1.insert(cur);
+        }
+
+        st2.assign(ins.begin(), ins.end());
+        for (int i = 0; i < K; i++) {
+            string cur(1, rand() % 26 + 'a');
+            st1.insert(cur);
+            st2.insert(cur);
+            st1.erase(ins[i]);
+            st2.erase(ins[i]);
+        }
+
+        vector<string> vec1, vec2;
+        for (const auto& c : st1) vec1.push_back(c);
+        for (const auto& c : st2) vec2.push_back(c);
+
+        if (vec1 != vec2) failed.push_back({ 2, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    // test3
+    try {
+        order_statistic_parallel_policy policy{ 4, 64 };
+        vector<string> vec;
+        for (int i = 0; i < 10 * K; i++) vec.push_back(to_string(ext_rand() % (5 * K)));
+        set<string> st1(vec.begin(), vec.end());
+        vector<string> sorted(st1.begin(), st1.end());
+
+        order_statistic_tree<string> st2(vec.begin(), vec.end(), policy), st3;
+        st3.assign(sorted.begin(), sorted.end(), policy);
+
+        vector<string> vec2, vec3;
+        for (int i = 0; i < st2.size(); i++) vec2.push_back(*st2.statistic(i));
+        for (auto it = st3.rbegin(); it != st3.rend(); it++) vec3.push_back(*it);
+        reverse(vec3.begin(), vec3.end());
+
+        if (vec2 != sorted || vec3 != sorted) failed.push_back({ 3, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 3, "re" });
+    }
+
+    // test4
+    try {
+        // of equal keys the first one of the range stays, as with the sequential build
+        struct compare {
+            bool operator()(const pair<int, int>& a, const pair<int, int>& b) const {
+                return a.first < b.first;
+            }
+        };
+
+        vector<pair<int, int>> vec;
+        for (int i = 0; i < 4 * K; i++) vec.push_back({ i % K, i / K });
+        order_statistic_tree<pair<int, int>, compare> st1(vec.begin(), vec.end(), order_statistic_parallel_policy{ 4, 16 });
+        shuffle(vec.begin(), vec.end(), mt19937(1));
+        order_statistic_tree<pair<int, int>, compare> st2(vec.begin(), vec.end(), order_statistic_parallel_policy{ 4, 16 }), st3(vec.begin(), vec.end());
+
+        bool first = st1.size() == K;
+        for (const auto& c : st1) first &= c.second == 0;
+        if (!first || vector<pair<int, int>>(st2.begin(), st2.end()) != vector<pair<int, int>>(st3.begin(), st3.end())) failed.push_back({ 4, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 4, "re" });
+    }
+
     result(__func__, failed.empty(), failed);
 }
 
@@ -849,6 +1072,44 @@ void statistic_test() {
 
 const int K2 = 1000;
 
+void order_of_key_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        set<int> st1;
+        order_statistic_tree<int> st2;
+        compact_order_statistic_tree<int> st3;
+
+        for (int i = 0; i < K; i++) {
+            int q = ext_rand() % K;
+            st1.insert(q);
+            st2.insert(q);
+            st3.insert(q);
+        }
+
+        vector<size_t> vec1, vec2, vec3;
+        for (int i = 0; i < K; i++) {
+            int lo = ext_rand() % (K + 2) - 1, hi = ext_rand() % (K + 2) - 1;
+            vec1.push_back(distance(st1.begin(), st1.lower_bound(lo)));
+            vec2.push_back(st2.order_of_key(lo));
+            vec3.push_back(st3.order_of_key(lo));
+
+            vec1.push_back(lo < hi ? distance(st1.lower_bound(lo), st1.lower_bound(hi)) : 0);
+            vec2.push_back(st2.count_range(lo, hi));
+            vec3.push_back(st3.count_range(lo, hi));
+        }
+
+        if (vec1 != vec2 || vec1 != vec3) failed.push_back({ 1, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
 void erase_test() {
     vector<pair<int, string>> failed;
     srand(1);
@@ -925,6 +1186,82 @@ void erase_test() {
         failed.push_back({ 1, "re" });
     }
 
+    // test3
+    try {
+        set<int> st1;
+        order_statistic_tree<int> st2;
+        for (int i = 0; i < 10 * K2; i++) {
+            int q = ext_rand() % (10 * K2);
+            st1.insert(q);
+            st2.insert(q);
+        }
+
+        for (int i = 0; i < K2 && !st1.empty(); i++) {
+            int tp = ext_rand() % 3, k = (ext_rand() & INT_MAX) % st1.size(), len = (ext_rand() & INT_MAX) % 20;
+            if (tp == 0) {
+                st1.erase(next(st1.begin(), k));
+                st2.erase_at(k);
+            } else if (tp == 1) {
+                auto it = next(st1.begin(), k);
+                auto it2 = next(it, min<int>(len, st1.size() - k));
+                auto res = st1.erase(it, it2);
+                auto res2 = st2.erase(st2.statistic(k), st2.statistic(k + len));
+                if ((res == st1.end()) != (res2 == st2.end()) || (res != st1.end() && *res != *res2)) failed.push_back({ 3, "wa" });
+            } else {
+                int lo = ext_rand() % (10 * K2), hi = lo + len * 10;
+                size_t cnt = distance(st1.lower_bound(lo), st1.lower_bound(hi));
+                st1.erase(st1.lower_bound(lo), st1.lower_bound(hi));
+                if (st2.erase_range(lo, hi) != cnt) failed.push_back({ 3, "wa" });
+            }
+        }
+
+        if (vector<int>(st1.begin(), st1.end()) != vector<int>(st2.begin(), st2.end()) || st1.size() != st2.size()) failed.push_back({ 3, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 3, "re" });
+    }
+
+    // test4
+    try {
+        multiset<int> st1;
+        order_statistic_multiset<int> st2;
+        for (int i = 0; i < 10 * K2; i++) {
+            int q = ext_rand() % K2;
+            st1.insert(q);
+            st2.insert(q);
+        }
+
+        while (!st1.empty()) {
+            int k = (ext_rand() & INT_MAX) % st1.size(), len = (ext_rand() & INT_MAX) % 50;
+            auto it = next(st1.begin(), k);
+            st1.erase(it, next(it, min<int>(len, st1.size() - k)));
+            st2.erase(st2.statistic(k), st2.statistic(k + len));
+
+            if (vector<int>(st1.begin(), st1.end()) != vector<int>(st2.begin(), st2.end())) failed.push_back({ 4, "wa" });
+
+            int q = ext_rand() % K2;
+            if (st1.count(q) != st2.count(q)) failed.push_back({ 4, "wa" });
+            if (k % 10 == 0) {
+                st1.erase(q);
+                st2.erase(q);
+                if (st2.contains(q) || st1.size() != st2.size()) failed.push_back({ 4, "wa" });
+            }
+        }
+        if (!st2.empty()) failed.push_back({ 4, "wa" });
+
+        // a range inside the copies of one key
+        for (int i = 0; i < 10; i++) st2.insert(7);
+        st2.insert(3);
+        st2.insert(9);
+        st2.erase(st2.statistic(4), st2.statistic(6));
+        if (st2.size() != 10 || st2.count(7) != 8) failed.push_back({ 4, "wa" });
+        st2.erase(7);
+        if (st2.size() != 2 || st2.contains(7)) failed.push_back({ 4, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 4, "re" });
+    }
+
     result(__func__, failed.empty(), failed);
 }
 
@@ -977,6 +1314,42 @@ void clear_and_empty_test() {
         failed.push_back({ 1, "re" });
     }
 
+    // test3
+    try {
+        set<string> st1;
+        order_statistic_tree<string> st2;
+
+        for (int it = 0; it < 3; it++) {
+            st1.clear();
+            st2.clear();
+
+            for (int i = 0; i < K2; i++) {
+                string ins;
+                for (int j = 0; j < rand() % 5 + 1; j++) {
+                    ins.push_back(rand() % 26 + 'a');
+                }
+                st1.insert(ins);
+                st2.insert(ins);
+
+                ins.clear();
+                for (int j = 0; j < rand() % 5 + 1; j++) {
+                    ins.push_back(rand() % 26 + 'a');
+                }
+                st1.erase(ins);
+                st2.erase(ins);
+            }
+        }
+
+        vector<string> vec1, vec2;
+        for (const auto& c : st1) vec1.push_back(c);
+        for (auto c : st2) vec2.push_back(c);
+
+        if (vec1 != vec2) failed.push_back({ 3, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 3, "re" });
+    }
+
     result(__func__, failed.empty(), failed);
 }
 
@@ -1017,15 +1390,1307 @@ void swap_test() {
     result(__func__, failed.empty(), failed);
 }
 
+void split_and_join_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        set<int> st1;
+        order_statistic_tree<int> st2;
+
+        for (int i = 0; i < K2; i++) {
+            int q = ext_rand() % K2;
+            st1.insert(q);
+            st2.insert(q);
+        }
+
+        for (int i = 0; i < K2 / 10; i++) {
+            int q = ext_rand() % (K2 + 2) - 1;
+            order_statistic_tree<int> right = st2.split_at_key(q);
+
+            vector<int> vec1(st1.begin(), st1.lower_bound(q)), vec2(st2.begin(), st2.end());
+            vector<int> vec3(st1.lower_bound(q), st1.end()), vec4(right.begin(), right.end());
+            if (vec1 != vec2 || vec3 != vec4) failed.push_back({ 1, "wa" });
+
+            int k = ext_rand() % (st1.size() + 1);
+            if (i % 2) {
+                right.join(std::move(st2));
+                st2 = std::move(right);
+            } else {
+                st2.join(std::move(right));
+            }
+
+            order_statistic_tree<int> tail = st2.split_at_rank(k);
+            if (st2.size() != k || tail.size() != st1.size() - k) failed.push_back({ 1, "wa" });
+
+            tail.insert(K2 + i);
+            st1.insert(K2 + i);
+            st2.join(std::move(tail));
+
+            order_statistic_tree<int>* extra = new order_statistic_tree<int>{ -2 * K2 - i - 1, -2 * K2 };
+            st2.join(std::move(*extra));
+            delete extra;
+            st2.erase(-2 * K2 - i - 1);
+            st2.erase(-2 * K2);
+            if (!tail.empty() || !(st2 == order_statistic_tree<int>(st1.begin(), st1.end()))) failed.push_back({ 1, "wa" });
+        }
+
+        bool thrown = false;
+        order_statistic_tree<int> other = { 10 };
+        try {
+            st2.join(std::move(other));
+        }
+        catch (std::invalid_argument&) {
+            thrown = true;
+        }
+        if (!thrown || other.size() != 1) failed.push_back({ 1, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        std::pmr::monotonic_buffer_resource res1, res2;
+        using pmr_tree = order_statistic_tree<string, less<string>, std::pmr::polymorphic_allocator<string>>;
+
+        vector<string> vec1;
+        pmr_tree st1(&res1);
+        {
+            pmr_tree st2(&res2), st3;
+            for (int i = 0; i < K2; i++) {
+                string cur = to_string(1000000 + i);
+                vec1.push_back(cur);
+                if (i < K2 / 3) st1.insert(cur);
+                else if (i < 2 * K2 / 3) st2.insert(cur);
+                else st3.insert(cur);
+            }
+
+            st1.join(std::move(st2));
+            st1.join(std::move(st3));
+        }
+
+        vector<string> vec2(st1.begin(), st1.end());
+        if (vec1 != vec2) failed.push_back({ 2, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    // test3
+    try {
+        // keys move between shards owned by different threads, a join leaves no pool shared between them
+        order_statistic_tree<int> st1, st2;
+        set<int> st3, st4;
+        for (int i = 0; i < 2 * K2; i++) {
+            st1.insert(i);
+            st3.insert(i);
+            st2.insert(10 * K2 + i);
+            st4.insert(10 * K2 + i);
+        }
+
+        order_statistic_tree<int> moved = st1.split_at_key(K2);
+        thread worker([&]() {
+            st2.join(std::move(moved));
+            for (int i = 0; i < 10 * K2; i++) {
+                st2.insert(20 * K2 + i);
+                st2.erase(20 * K2 + i / 2);
+            }
+        });
+        for (int i = 0; i < 10 * K2; i++) {
+            st1.insert(-i);
+            st1.erase(-i / 2);
+        }
+        worker.join();
+
+        for (int i = 0; i < 10 * K2; i++) {
+            st3.insert(-i);
+            st3.erase(-i / 2);
+            st4.insert(20 * K2 + i);
+            st4.erase(20 * K2 + i / 2);
+        }
+        for (int i = K2; i < 2 * K2; i++) {
+            st3.erase(i);
+            st4.insert(i);
+        }
+        if (vector<int>(st1.begin(), st1.end()) != vector<int>(st3.begin(), st3.end()) ||
+            vector<int>(st2.begin(), st2.end()) != vector<int>(st4.begin(), st4.end()) || !moved.empty()) failed.push_back({ 3, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 3, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void set_operations_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        for (int sz : { 1, 10, K2, 10 * K2 }) {
+            for (int op = 0; op < 3; op++) {
+                set<int> st1, st2;
+                order_statistic_tree<int> st3, st4;
+                for (int i = 0; i < K2; i++) {
+                    int q = ext_rand() % (2 * K2);
+                    st1.insert(q);
+                    st3.insert(q);
+                }
+                for (int i = 0; i < sz; i++) {
+                    int q = ext_rand() % (2 * K2);
+                    st2.insert(q);
+                    st4.insert(q);
+                }
+
+                vector<int> vec1, vec2;
+                if (op == 0) {
+                    set_union(st1.begin(), st1.end(), st2.begin(), st2.end(), back_inserter(vec1));
+                    st3.union_with(std::move(st4));
+                } else if (op == 1) {
+                    set_intersection(st1.begin(), st1.end(), st2.begin(), st2.end(), back_inserter(vec1));
+                    st3.intersect_with(st4);
+                } else {
+                    set_difference(st1.begin(), st1.end(), st2.begin(), st2.end(), back_inserter(vec1));
+                    st3.difference_with(std::move(st4));
+                }
+
+                for (int i = 0; i < st3.size(); i++) vec2.push_back(*st3.statistic(i));
+                if (vec1 != vec2) failed.push_back({ 1, "wa" });
+                if (op == 1 && vector<int>(st4.begin(), st4.end()) != vector<int>(st2.begin(), st2.end())) failed.push_back({ 1, "wa" });
+            }
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        set<string> st1;
+        order_statistic_tree<string> st2;
+        for (int i = 0; i < K2; i++) {
+            string cur = to_string(ext_rand() % K2);
+            st1.insert(cur);
+            st2.insert(cur);
+        }
+
+        order_statistic_tree<string> st3 = st2.split_at_rank(st2.size() / 2);
+        st3.insert("#");
+        st2.insert("#");
+        st2.union_with(std::move(st3));
+        st1.insert("#");
+
+        vector<string> vec1(st1.begin(), st1.end()), vec2(st2.begin(), st2.end());
+        if (vec1 != vec2 || !st3.empty()) failed.push_back({ 2, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    // test3
+    try {
+        order_statistic_parallel_policy policy{ 4, 64 };
+        for (int op = 0; op < 3; op++) {
+            set<int> st1, st2;
+            for (int i = 0; i < 10 * K2; i++) st1.insert(ext_rand() % (20 * K2));
+            for (int i = 0; i < 5 * K2; i++) st2.insert(ext_rand() % (20 * K2));
+            order_statistic_tree<int> st3(st1.begin(), st1.end()), st4(st2.begin(), st2.end());
+
+            vector<int> vec1, vec2;
+            if (op == 0) {
+                set_union(st1.begin(), st1.end(), st2.begin(), st2.end(), back_inserter(vec1));
+                st3.union_with(std::move(st4), policy);
+            } else if (op == 1) {
+                set_intersection(st1.begin(), st1.end(), st2.begin(), st2.end(), back_inserter(vec1));
+                st3.intersect_with(std::move(st4), policy);
+            } else {
+                set_difference(st1.begin(), st1.end(), st2.begin(), st2.end(), back_inserter(vec1));
+                st3.difference_with(std::move(st4), policy);
+            }
+
+            for (int i = 0; i < st3.size(); i++) vec2.push_back(*st3.statistic(i));
+            if (vec1 != vec2) failed.push_back({ 3, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 3, "re" });
+    }
+
+    // test4
+    try {
+        // keys compare by the first component only, so the second one tells which tree an element came from
+        struct compare {
+            bool operator()(const pair<int, int>& a, const pair<int, int>& b) const {
+                return a.first < b.first;
+            }
+        };
+
+        for (int op = 0; op < 2; op++) {
+            for (unsigned threads : { 1u, 4u }) {
+                order_statistic_tree<pair<int, int>, compare> st1, st2;
+                for (int i = 0; i < 10 * K2; i++) st1.insert({ ext_rand() % (20 * K2), 0 });
+                for (int i = 0; i < 10 * K2; i++) st2.insert({ ext_rand() % (20 * K2), 1 });
+
+                vector<pair<order_statistic_tree<pair<int, int>, compare>::const_iterator, pair<int, int>>> held;
+                for (auto it = st1.begin(); it != st1.end(); it++) {
+                    if (op == 0 || st2.contains(*it)) held.push_back({ it, *it });
+                }
+
+                order_statistic_parallel_policy policy{ threads, 64 };
+                if (op == 0) st1.union_with(std::move(st2), policy);
+                else st1.intersect_with(std::move(st2), policy);
+
+                bool kept = st1.size() >= held.size();
+                for (const auto& c : held) kept &= *c.first == c.second && *st1.find(c.second) == c.second;
+                if (!kept) failed.push_back({ 4, "wa" });
+            }
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 4, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void multiset_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        multiset<int> st1;
+        order_statistic_multiset<int> st2;
+        for (int i = 0; i < 10 * K2; i++) {
+            int q = ext_rand() % (K2 / 10), tp = ext_rand() % 10;
+            if (tp < 6) {
+                st1.insert(q);
+                st2.insert(q);
+            } else if (tp < 9) {
+                if (st1.find(q) != st1.end()) st1.erase(st1.find(q));
+                if (st2.find(q) != st2.end()) st2.erase(st2.find(q));
+            } else {
+                st1.erase(q);
+                st2.erase(q);
+            }
+
+            if (st1.size() != st2.size() || st1.count(q) != st2.count(q)) failed.push_back({ 1, "wa" });
+            if (distance(st1.begin(), st1.lower_bound(q)) != st2.order_of_key(q)) failed.push_back({ 1, "wa" });
+            if (st2.find(q) != st2.end() && st2.find(q) - st2.begin() != st2.order_of_key(q)) failed.push_back({ 1, "wa" });
+        }
+
+        vector<int> vec1(st1.begin(), st1.end()), vec2(st2.begin(), st2.end()), vec3, vec4;
+        for (auto it = st2.rbegin(); it != st2.rend(); ++it) vec3.push_back(*it);
+        for (int i = 0; i < st2.size(); i++) vec4.push_back(*st2.statistic(i));
+        reverse(vec3.begin(), vec3.end());
+        if (vec1 != vec2 || vec1 != vec3 || vec1 != vec4) failed.push_back({ 1, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        vector<int> vec1;
+        for (int i = 0; i < K2; i++) vec1.push_back(ext_rand() % (K2 / 10));
+        order_statistic_multiset<int> st1(vec1.begin(), vec1.end());
+        sort(vec1.begin(), vec1.end());
+        order_statistic_multiset<int> st2(vec1.begin(), vec1.end());
+
+        for (size_t k : { size_t(0), size_t(1), vec1.size() / 3, vec1.size() / 2, vec1.size() }) {
+            order_statistic_multiset<int> st3 = st1, st4 = st3.split_at_rank(k);
+            vector<int> vec2(st3.begin(), st3.end()), vec3(st4.begin(), st4.end());
+            if (vec2 != vector<int>(vec1.begin(), vec1.begin() + k)) failed.push_back({ 2, "wa" });
+            if (vec3 != vector<int>(vec1.begin() + k, vec1.end())) failed.push_back({ 2, "wa" });
+
+            // the halves may share the boundary key, joining them folds its copies into one node
+            if (k % 2) {
+                st4.join(std::move(st3));
+                st3.swap(st4);
+            } else {
+                st3.join(std::move(st4));
+            }
+            int q = vec1[min(k, vec1.size() - 1)];
+            if (st3 != st1 || st3.count(q) != st1.count(q)) failed.push_back({ 2, "wa" });
+            st3.erase(q);
+            if (st3.contains(q) || st3.size() != st1.size() - st1.count(q)) failed.push_back({ 2, "wa" });
+        }
+
+        if (st1 != st2 || vector<int>(st1.begin(), st1.end()) != vec1) failed.push_back({ 2, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    // test3
+    try {
+        for (int op = 0; op < 3; op++) {
+            multiset<int> st1, st2;
+            order_statistic_multiset<int> st3, st4;
+            for (int i = 0; i < K2; i++) {
+                int q = ext_rand() % (K2 / 4);
+                st1.insert(q);
+                st3.insert(q);
+                q = ext_rand() % (K2 / 4);
+                st2.insert(q);
+                st4.insert(q);
+            }
+
+            vector<int> vec1;
+            if (op == 0) {
+                merge(st1.begin(), st1.end(), st2.begin(), st2.end(), back_inserter(vec1));
+                st3.union_with(std::move(st4));
+            } else if (op == 1) {
+                set_intersection(st1.begin(), st1.end(), st2.begin(), st2.end(), back_inserter(vec1));
+                st3.intersect_with(std::move(st4));
+            } else {
+                set_difference(st1.begin(), st1.end(), st2.begin(), st2.end(), back_inserter(vec1));
+                st3.difference_with(std::move(st4));
+            }
+
+            if (vector<int>(st3.begin(), st3.end()) != vec1 || st3.size() != vec1.size()) failed.push_back({ 3, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 3, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void map_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        map<int, long long> st1;
+        order_statistic_map<int, long long> st2;
+        for (int i = 0; i < 10 * K2; i++) {
+            int q = ext_rand() % K2, tp = ext_rand() % 4;
+            if (tp == 0) {
+                st1[q] += i;
+                st2[q] += i;
+            } else if (tp == 1) {
+                st1.erase(q);
+                st2.erase(q);
+            } else if (tp == 2) {
+                st1.insert({ q, i });
+                st2.insert({ q, i });
+            } else {
+                bool found = st1.count(q);
+                try {
+                    if (st2.at(q) != st1.at(q)) failed.push_back({ 1, "wa" });
+                    if (!found) failed.push_back({ 1, "wa" });
+                }
+                catch (const out_of_range&) {
+                    if (found) failed.push_back({ 1, "wa" });
+                }
+            }
+        }
+
+        vector<pair<int, long long>> vec1(st1.begin(), st1.end()), vec2;
+        for (int i = 0; i < st2.size(); i++) vec2.push_back(*st2.statistic(i));
+        if (vec1 != vec2) failed.push_back({ 1, "wa" });
+
+        for (int i = 0; i < K2; i++) {
+            int q = ext_rand() % K2;
+            if (distance(st1.begin(), st1.lower_bound(q)) != st2.order_of_key(q)) failed.push_back({ 1, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        order_statistic_map<string, vector<int>> st1;
+        for (int i = 0; i < K2; i++) st1[to_string(i % 100)].push_back(i);
+
+        order_statistic_map<string, vector<int>> st2 = { { "5", { 1 } } };
+        st2.insert_or_assign("5", st1.at("5"));
+        st2.try_emplace("7", 3, 7);
+
+        if (st1.size() != 100 || st1.at("5").size() != K2 / 100 || st1.statistic(0)->first != "0") failed.push_back({ 2, "wa" });
+        if (st2.at("5") != st1.at("5") || st2.at("7") != vector<int>(3, 7) || st2 == st1) failed.push_back({ 2, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void augmentation_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        multiset<int> st1;
+        order_statistic_multiset<int, less<int>, allocator<int>, order_statistic_sum<long long>> st2;
+        order_statistic_tree<int, less<int>, allocator<int>, false, order_statistic_min<int>> st3;
+        for (int i = 0; i < 10 * K2; i++) {
+            int q = ext_rand() % K2, tp = ext_rand() % 3;
+            if (tp < 2) {
+                st1.insert(q);
+                st2.insert(q);
+                st3.insert(q);
+            } else {
+                if (st1.find(q) != st1.end()) st1.erase(st1.find(q));
+                if (st2.find(q) != st2.end()) st2.erase(st2.find(q));
+                if (st1.find(q) == st1.end()) st3.erase(q);
+            }
+
+            if (i % 10) continue;
+            vector<int> vec(st1.begin(), st1.end());
+            size_t k = ext_rand() % (vec.size() + 1);
+            int lo = ext_rand() % K2, hi = ext_rand() % K2;
+
+            long long sum = 0, range_sum = 0;
+            for (size_t j = 0; j < k; j++) sum += vec[j];
+            for (int x : vec) range_sum += (lo <= x && x < hi ? x : 0);
+            auto it = st1.lower_bound(lo);
+            int range_min = (it != st1.end() && *it < hi) ? *it : INT_MAX;
+
+            if (st2.aggregate() != accumulate(vec.begin(), vec.end(), 0LL)) failed.push_back({ 1, "wa" });
+            if (st2.aggregate_prefix(k) != sum || st2.aggregate_range(lo, hi) != range_sum) failed.push_back({ 1, "wa" });
+            if (st3.aggregate_range(lo, hi) != range_min || st3.aggregate() != (vec.empty() ? INT_MAX : vec[0])) failed.push_back({ 1, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        using sum_tree = order_statistic_tree<int, less<int>, allocator<int>, false, order_statistic_sum<long long>>;
+        vector<int> vec;
+        for (int i = 0; i < K2; i++) vec.push_back(ext_rand() % (10 * K2));
+        sum_tree st1(vec.begin(), vec.end()), st2 = st1;
+        sum_tree st3 = st2.split_at_key(5 * K2);
+        st3.intersect_with(sum_tree(vec.begin(), vec.end()));
+        st2.join(std::move(st3));
+
+        set<int> st4(vec.begin(), vec.end());
+        long long sum = accumulate(st4.begin(), st4.end(), 0LL);
+        if (st1.aggregate() != sum || st2.aggregate() != sum || st1.aggregate_prefix(st1.size()) != sum) failed.push_back({ 2, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+struct weight_sum {
+    using value_type = long long;
+
+    static long long identity() {
+        return 0;
+    }
+
+    static long long value(const pair<int, int>& key, int cnt) {
+        return (long long)key.second * cnt;
+    }
+
+    static long long combine(long long a, long long b) {
+        return a + b;
+    }
+};
+
+void weighted_statistic_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        set<pair<int, int>> st1;
+        order_statistic_tree<pair<int, int>, less<pair<int, int>>, allocator<pair<int, int>>, false, weight_sum> st2;
+        for (int i = 0; i < K2; i++) {
+            pair<int, int> q = { ext_rand() % K2, abs(ext_rand() % 10) };
+            st1.insert(q);
+            st2.insert(q);
+        }
+
+        vector<pair<int, int>> vec(st1.begin(), st1.end());
+        vector<long long> pref = { 0 };
+        for (auto& [key, w] : vec) pref.push_back(pref.back() + w);
+
+        for (int i = 0; i < K2; i++) {
+            long long w = ext_rand() % (pref.back() + 10);
+            size_t ind = upper_bound(pref.begin() + 1, pref.end(), w) - pref.begin() - 1;
+            auto it = st2.weighted_statistic(w);
+            if (ind == vec.size() ? it != st2.end() : (it == st2.end() || *it != vec[ind])) failed.push_back({ 1, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        multiset<int> st1;
+        order_statistic_multiset<int, less<int>, allocator<int>, order_statistic_sum<long long>> st2;
+        for (int i = 0; i < K2; i++) {
+            int q = abs(ext_rand() % 100) + 1;
+            st1.insert(q);
+            st2.insert(q);
+        }
+
+        vector<int> vec(st1.begin(), st1.end());
+        vector<long long> pref = { 0 };
+        for (int x : vec) pref.push_back(pref.back() + x);
+
+        for (int i = 0; i <= 100; i++) {
+            double p = i / 100.0;
+            size_t ind = lower_bound(pref.begin() + 1, pref.end(), p * pref.back()) - pref.begin() - 1;
+            auto it = st2.percentile(p);
+            if (*it != vec[ind] || it - st2.begin() != ind) failed.push_back({ 2, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void shift_range_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        set<long long> st1;
+        order_statistic_tree<long long, less<long long>, allocator<long long>, false, order_statistic_sum<long long>, true> st2;
+        for (int i = 0; i < 10 * K2; i++) {
+            long long q = ext_rand() % (100 * K2), tp = ext_rand() % 4;
+            if (tp == 0) {
+                st1.insert(q);
+                st2.insert(q);
+            } else if (tp == 1) {
+                st1.erase(q);
+                st2.erase(q);
+            } else if (tp == 2) {
+                long long hi = q + abs(ext_rand() % (10 * K2)), d = ext_rand() % 1000;
+                vector<long long> vec1(st1.lower_bound(q), st1.upper_bound(hi));
+                auto it = st1.lower_bound(q), it2 = st1.upper_bound(hi);
+                bool ordered = vec1.empty() || ((it == st1.begin() || *prev(it) < vec1[0] + d) && (it2 == st1.end() || vec1.back() + d < *it2));
+
+                bool thrown = false;
+                try {
+                    st2.shift_range(q, hi, d);
+                }
+                catch (const invalid_argument&) {
+                    thrown = true;
+                }
+
+                if (thrown == ordered) failed.push_back({ 1, "wa" });
+                if (ordered) {
+                    st1.erase(st1.lower_bound(q), st1.upper_bound(hi));
+                    for (long long x : vec1) st1.insert(x + d);
+                }
+            } else {
+                if (st1.count(q) != st2.contains(q) || distance(st1.begin(), st1.lower_bound(q)) != st2.order_of_key(q)) failed.push_back({ 1, "wa" });
+            }
+
+            if (st1.size() != st2.size() || st2.aggregate() != accumulate(st1.begin(), st1.end(), 0LL)) failed.push_back({ 1, "wa" });
+        }
+
+        vector<long long> vec1(st1.begin(), st1.end()), vec2(st2.begin(), st2.end()), vec3;
+        for (int i = 0; i < st2.size(); i++) vec3.push_back(*st2.statistic(i));
+        if (vec1 != vec2 || vec1 != vec3) failed.push_back({ 1, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        vector<long long> vec1;
+        order_statistic_multiset<long long, less<long long>, allocator<long long>, order_statistic_min<long long>, true> st1;
+        for (int i = 0; i < K2; i++) {
+            long long q = ext_rand() % K2;
+            vec1.push_back(q);
+            st1.insert(q);
+            if (i % 3 == 0) {
+                for (long long& x : vec1) x += (x >= q ? 2 : 0);
+                st1.shift_range(q, LLONG_MAX / 2, 2);
+            }
+        }
+
+        sort(vec1.begin(), vec1.end());
+        vector<long long> vec2(st1.begin(), st1.end());
+        if (vec1 != vec2 || st1.aggregate_range(K2 / 2, LLONG_MAX) != *lower_bound(vec1.begin(), vec1.end(), K2 / 2)) failed.push_back({ 2, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void sequence_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        vector<int> vec1;
+        order_statistic_sequence<int> st1;
+        for (int i = 0; i < 10 * K2; i++) {
+            int tp = ext_rand() % 5, pos = (ext_rand() & INT_MAX) % (vec1.size() + 1);
+            if (tp < 2) {
+                vec1.insert(vec1.begin() + pos, i);
+                st1.insert_at(pos, i);
+            } else if (tp == 2 && pos < vec1.size()) {
+                vec1.erase(vec1.begin() + pos);
+                st1.erase_at(pos);
+            } else if (tp == 3 && pos < vec1.size()) {
+                vec1[pos] = -i;
+                st1[pos] = -i;
+            } else if (tp == 4) {
+                // moves a block of values to another position
+                int len = (ext_rand() & INT_MAX) % (vec1.size() - pos + 1);
+                vector<int> block(vec1.begin() + pos, vec1.begin() + pos + len);
+                vec1.erase(vec1.begin() + pos, vec1.begin() + pos + len);
+                int pos2 = (ext_rand() & INT_MAX) % (vec1.size() + 1);
+                vec1.insert(vec1.begin() + pos2, block.begin(), block.end());
+
+                order_statistic_sequence<int> st2 = st1.cut(pos, len);
+                order_statistic_sequence<int> st3 = st1.cut(pos2, st1.size() - pos2);
+                st1.concat(std::move(st2));
+                st1.concat(std::move(st3));
+                if (!st2.empty() || !st3.empty()) failed.push_back({ 1, "wa" });
+            }
+
+            if (st1.size() != vec1.size() || (!vec1.empty() && st1.at(pos % vec1.size()) != vec1[pos % vec1.size()])) failed.push_back({ 1, "wa" });
+        }
+
+        if (vector<int>(st1.begin(), st1.end()) != vec1) failed.push_back({ 1, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        vector<string> vec1;
+        for (int i = 0; i < K2; i++) vec1.push_back(to_string(ext_rand() % K2));
+        order_statistic_sequence<string> st1(vec1.begin(), vec1.end()), st2 = st1;
+        st2.push_back("#");
+
+        bool thrown = false;
+        try {
+            st1.erase_at(st1.size());
+        }
+        catch (const out_of_range&) {
+            thrown = true;
+        }
+
+        if (vector<string>(st1.begin(), st1.end()) != vec1 || st2.size() != K2 + 1 || st2[K2] != "#" || !thrown) failed.push_back({ 2, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void node_handle_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        vector<set<int>> st1(4);
+        vector<order_statistic_tree<int>> st2(4);
+        for (int i = 0; i < K2; i++) {
+            int q = ext_rand() % K2, c = i % 4;
+            st1[c].insert(q);
+            st2[c].insert(q);
+        }
+
+        for (int i = 0; i < 10 * K2; i++) {
+            int q = ext_rand() % K2, from = (ext_rand() & INT_MAX) % 4, to = (ext_rand() & INT_MAX) % 4;
+            auto nh1 = st1[from].extract(q);
+            auto nh2 = st2[from].extract(q);
+            if (nh1.empty() != nh2.empty()) failed.push_back({ 1, "wa" });
+            if (nh1.empty()) continue;
+
+            if (i % 2) {
+                nh1.value() += K2;
+                nh2.value() += K2;
+            }
+            auto res1 = st1[to].insert(std::move(nh1));
+            auto res2 = st2[to].insert(std::move(nh2));
+            if (res1.inserted != res2.inserted || res1.node.empty() != res2.node.empty() || *res1.position != *res2.position) failed.push_back({ 1, "wa" });
+            if (!res2.inserted && res2.node.value() != *res2.position) failed.push_back({ 1, "wa" });
+        }
+
+        for (int c = 0; c < 4; c++) {
+            if (vector<int>(st1[c].begin(), st1[c].end()) != vector<int>(st2[c].begin(), st2[c].end())) failed.push_back({ 1, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        std::pmr::unsynchronized_pool_resource resource1, resource2;
+        using pmr_multiset = order_statistic_multiset<string, less<string>, std::pmr::polymorphic_allocator<string>>;
+        pmr_multiset st1(&resource1), st2(&resource2);
+        multiset<string> st3, st4;
+        for (int i = 0; i < K2; i++) {
+            string q = to_string(ext_rand() % 100);
+            st1.insert(q);
+            st3.insert(q);
+        }
+
+        for (int i = 0; i < K2; i++) {
+            string q = to_string(ext_rand() % 100);
+            if (st3.count(q)) st4.insert(st3.extract(q));
+            auto nh = st1.extract(q);
+            if (!nh.empty()) st2.insert(std::move(nh));
+        }
+
+        if (vector<string>(st1.begin(), st1.end()) != vector<string>(st3.begin(), st3.end())) failed.push_back({ 2, "wa" });
+        if (vector<string>(st2.begin(), st2.end()) != vector<string>(st4.begin(), st4.end())) failed.push_back({ 2, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    // test3
+    try {
+        // handles moved to a tree which is modified by another thread
+        set<int> st1, st2;
+        order_statistic_tree<int> st3, st4;
+        for (int i = 0; i < K2; i++) {
+            st1.insert(i);
+            st3.insert(i);
+        }
+
+        vector<order_statistic_tree<int>::node_type> handles;
+        for (int i = 0; i < K2; i += 2) {
+            st1.erase(i);
+            st2.insert(i);
+            handles.push_back(st3.extract(i));
+        }
+
+        auto churn = [](order_statistic_tree<int>& st, set<int>& ref, unsigned seed) {
+            mt19937 gen(seed);
+            for (int i = 0; i < 10 * K2; i++) {
+                int q = K2 + gen() % K2;
+                if (gen() % 2) {
+                    st.insert(q);
+                    ref.insert(q);
+                } else {
+                    st.erase(q);
+                    ref.erase(q);
+                }
+            }
+        };
+
+        thread other([&]() {
+            for (auto& nh : handles) st4.insert(std::move(nh));
+            churn(st4, st2, 2);
+        });
+        churn(st3, st1, 1);
+        other.join();
+
+        if (vector<int>(st1.begin(), st1.end()) != vector<int>(st3.begin(), st3.end())) failed.push_back({ 3, "wa" });
+        if (vector<int>(st2.begin(), st2.end()) != vector<int>(st4.begin(), st4.end())) failed.push_back({ 3, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 3, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void batch_lookup_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        order_statistic_tree<int> st;
+        for (int i = 0; i < K2; i++) st.insert(ext_rand() % (2 * K2));
+
+        vector<int> queries(3 * K2 + 7);
+        for (auto& q : queries) q = ext_rand() % (2 * K2 + 10);
+
+        vector<bool> found;
+        vector<order_statistic_tree<int>::const_iterator> bounds(queries.size());
+        st.contains_many(queries.begin(), queries.end(), back_inserter(found));
+        auto out = st.lower_bound_many(queries.begin(), queries.end(), bounds.begin());
+
+        if (found.size() != queries.size() || out != bounds.end()) failed.push_back({ 1, "wa" });
+        for (size_t i = 0; i < queries.size(); i++) {
+            if (found[i] != st.contains(queries[i]) || bounds[i] != st.lower_bound(queries[i])) failed.push_back({ 1, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        order_statistic_multiset<int, less<int>, allocator<int>, order_statistic_no_augment, true> st;
+        for (int i = 0; i < K2; i++) st.insert(ext_rand() % (K2 / 10));
+        st.shift_range(K2 / 20, K2, K2);
+
+        vector<int> ranks(2 * K2);
+        for (auto& q : ranks) q = ext_rand() % (K2 + 10);
+        ranks[0] = -1;
+        ranks[1] = K2;
+
+        vector<order_statistic_multiset<int, less<int>, allocator<int>, order_statistic_no_augment, true>::const_iterator> res;
+        st.statistic_many(ranks.begin(), ranks.end(), back_inserter(res));
+        for (size_t i = 0; i < ranks.size(); i++) {
+            auto expected = ranks[i] < 0 ? st.end() : st.statistic(ranks[i]);
+            if (res[i] != expected || (expected != st.end() && expected - st.begin() != ranks[i])) failed.push_back({ 2, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void sorted_batch_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        set<int> st1;
+        order_statistic_tree<int> st2;
+        for (int i = 0; i < 5; i++) {
+            vector<int> keys(K2 * (i + 1));
+            for (auto& q : keys) q = ext_rand() % (10 * K2);
+            if (i % 2 == 0) sort(keys.begin(), keys.end());
+
+            st1.insert(keys.begin(), keys.end());
+            st2.insert_sorted(keys.begin(), keys.end());
+            if (st2.size() != st1.size()) failed.push_back({ 1, "wa" });
+        }
+
+        if (vector<int>(st1.begin(), st1.end()) != vector<int>(st2.begin(), st2.end())) failed.push_back({ 1, "wa" });
+
+        vector<int> queries(K2);
+        for (auto& q : queries) q = ext_rand() % (11 * K2);
+        sort(queries.begin(), queries.end());
+        queries.back() = 11 * K2;
+
+        vector<order_statistic_tree<int>::const_iterator> res;
+        st2.lower_bound_sorted(queries.begin(), queries.end(), back_inserter(res));
+        for (size_t i = 0; i < queries.size(); i++) {
+            auto it = st1.lower_bound(queries[i]);
+            if ((it == st1.end()) != (res[i] == st2.end()) || (it != st1.end() && *it != *res[i])) failed.push_back({ 1, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        multiset<int> st1;
+        order_statistic_multiset<int, less<int>, allocator<int>, order_statistic_sum<long long>> st2;
+        for (int i = 0; i < 5; i++) {
+            vector<int> keys(K2);
+            for (auto& q : keys) q = ext_rand() % K2;
+            if (i % 2) sort(keys.begin(), keys.end());
+
+            st1.insert(keys.begin(), keys.end());
+            st2.insert_sorted(keys.begin(), keys.end());
+        }
+
+        if (vector<int>(st1.begin(), st1.end()) != vector<int>(st2.begin(), st2.end())) failed.push_back({ 2, "wa" });
+        if (st2.aggregate() != accumulate(st1.begin(), st1.end(), 0LL)) failed.push_back({ 2, "wa" });
+
+        vector<int> queries(K2);
+        for (auto& q : queries) q = ext_rand() % K2;
+
+        vector<order_statistic_multiset<int, less<int>, allocator<int>, order_statistic_sum<long long>>::const_iterator> res(K2);
+        st2.lower_bound_sorted(queries.begin(), queries.end(), res.begin());
+        for (int i = 0; i < K2; i++) {
+            if (res[i] != st2.lower_bound(queries[i])) failed.push_back({ 2, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    // test3
+    try {
+        // keys compare by the first component only, the second one tells where an element came from
+        struct compare {
+            bool operator()(const pair<int, int>& a, const pair<int, int>& b) const {
+                return a.first < b.first;
+            }
+        };
+
+        order_statistic_tree<pair<int, int>, compare> st1;
+        map<int, int> st2;
+        for (int i = 0; i < K2; i++) {
+            int q = ext_rand() % (2 * K2);
+            st1.insert({ q, -1 });
+            st2.insert({ q, -1 });
+        }
+
+        vector<pair<order_statistic_tree<pair<int, int>, compare>::const_iterator, pair<int, int>>> held;
+        for (auto it = st1.begin(); it != st1.end(); it++) held.push_back({ it, *it });
+
+        vector<pair<int, int>> keys(K2);
+        for (int i = 0; i < K2; i++) {
+            keys[i] = { ext_rand() % (2 * K2), i };
+            st2.insert(keys[i]);
+        }
+        st1.insert_sorted(keys.begin(), keys.end());
+
+        bool kept = vector<pair<int, int>>(st1.begin(), st1.end()) == vector<pair<int, int>>(st2.begin(), st2.end());
+        for (const auto& c : held) kept &= *c.first == c.second;
+        if (!kept) failed.push_back({ 3, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 3, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void frozen_tree_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        order_statistic_multiset<int> st1;
+        for (int i = 0; i < K2; i++) st1.insert(ext_rand() % (K2 / 2));
+        auto st2 = st1.freeze();
+
+        if (st2.size() != st1.size() || vector<int>(st1.begin(), st1.end()) != vector<int>(st2.begin(), st2.end())) failed.push_back({ 1, "wa" });
+        if (vector<int>(st1.rbegin(), st1.rend()) != vector<int>(st2.rbegin(), st2.rend())) failed.push_back({ 1, "wa" });
+
+        for (int i = 0; i < K2; i++) {
+            int q = ext_rand() % (K2 / 2 + 10), q2 = ext_rand() % (K2 / 2 + 10), k = (ext_rand() & INT_MAX) % (K2 + 5);
+            if (st2.contains(q) != st1.contains(q) || st2.count(q) != st1.count(q)) failed.push_back({ 1, "wa" });
+            if (st2.order_of_key(q) != st1.order_of_key(q) || st2.count_range(q, q2) != st1.count_range(q, q2)) failed.push_back({ 1, "wa" });
+            if (st2.lower_bound(q) - st2.begin() != st1.lower_bound(q) - st1.begin()) failed.push_back({ 1, "wa" });
+            if (st2.upper_bound(q) - st2.begin() != st1.upper_bound(q) - st1.begin()) failed.push_back({ 1, "wa" });
+            if ((st2.find(q) == st2.end()) != (st1.find(q) == st1.end())) failed.push_back({ 1, "wa" });
+
+            auto it = st2.statistic(k);
+            if ((it == st2.end()) != (k >= st1.size()) || (it != st2.end() && (*it != *st1.statistic(k) || it.get_index() != k))) failed.push_back({ 1, "wa" });
+            if (it != st2.end() && (it - st2.begin() != k || st2.begin() + k != it || it[-k] != *st1.begin())) failed.push_back({ 1, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        for (int n = 0; n < 70; n++) {
+            order_statistic_tree<int> st1;
+            for (int i = 0; i < n; i++) st1.insert(2 * i);
+            frozen_order_statistic_tree<int> st2 = st1.freeze();
+
+            if (vector<int>(st1.begin(), st1.end()) != vector<int>(st2.begin(), st2.end())) failed.push_back({ 2, "wa" });
+            vector<int> vec;
+            for (auto it = st2.end(); it != st2.begin();) vec.push_back(*--it);
+            if (vector<int>(st1.rbegin(), st1.rend()) != vec) failed.push_back({ 2, "wa" });
+
+            for (int q = -1; q <= 2 * n; q++) {
+                auto it = st2.lower_bound(q);
+                if ((it == st2.end() ? 2 * n : *it) != (q + 1) / 2 * 2 || st2.order_of_key(q) != (q + 1) / 2) failed.push_back({ 2, "wa" });
+                if (st2.contains(q) != (q >= 0 && q < 2 * n && q % 2 == 0)) failed.push_back({ 2, "wa" });
+            }
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    // test3
+    try {
+        // the snapshot takes one slot per distinct key
+        order_statistic_multiset<int> st1;
+        for (int i = 0; i < K2 * K2; i++) st1.insert(i % 3);
+        auto st2 = st1.freeze();
+
+        if (st2.size() != K2 * K2 || st2.count(1) != st1.count(1) || st2.order_of_key(2) != st1.order_of_key(2)) failed.push_back({ 3, "wa" });
+        if (*st2.statistic(K2 * K2 / 2) != *st1.statistic(K2 * K2 / 2) || *st2.rbegin() != 2) failed.push_back({ 3, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 3, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void copy_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        set<string> st1;
+        order_statistic_tree<string> st2;
+
+        for (int i = 0; i < K2; i++) {
+            string ins;
+            for (int j = 0; j < rand() % 3 + 1; j++) {
+                ins.push_back(rand() % 26 + 'a');
+            }
+            st1.insert(ins);
+            st2.insert(ins);
+        }
+
+        order_statistic_tree<string> st3(st2), st4;
+        st4 = st3;
+        st4 = st4;
+        if (!(st3 == st2) || st4 != st2) failed.push_back({ 1, "wa" });
+
+        for (int i = 0; i < K2; i++) {
+            string ins(1, rand() % 26 + 'a');
+            st2.erase(ins);
+            st3.insert(ins + ins);
+        }
+
+        vector<string> vec1, vec3, vec4;
+        for (const auto& c : st1) vec1.push_back(c);
+        for (int i = 0; i < st4.size(); i++) vec4.push_back(*st4.statistic(i));
+        for (auto it = st4.rbegin(); it != st4.rend(); it++) vec3.push_back(*it);
+        reverse(vec3.begin(), vec3.end());
+
+        if (vec1 != vec4 || vec1 != vec3 || st3 == st4 || st2 == st4) failed.push_back({ 1, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        std::byte buffer[1 << 13];
+        std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+        using pmr_multiset = order_statistic_multiset<int, less<int>, std::pmr::polymorphic_allocator<int>>;
+
+        // a copy takes one node per distinct key, not per copy
+        pmr_multiset st1(&resource), st2(&resource);
+        for (int i = 0; i < K2 * K2; i++) st1.insert(i % 3);
+        st2 = st1;
+
+        if (st2.size() != K2 * K2 || st2.count(1) != st1.count(1) || !(st1 == st2)) failed.push_back({ 2, "wa" });
+    }
+    catch (std::bad_alloc&) {
+        failed.push_back({ 2, "re" });
+    }
+
+    // test3
+    try {
+        // moves steal the memory of the tree and leave it empty but usable, they allocate nothing
+        if (!is_nothrow_move_constructible<order_statistic_tree<string>>::value ||
+            !is_nothrow_move_assignable<order_statistic_tree<string>>::value) failed.push_back({ 3, "wa" });
+
+        set<string> st1;
+        order_statistic_tree<string> st2;
+        for (int i = 0; i < K2; i++) {
+            string cur = to_string(ext_rand() % K2);
+            st1.insert(cur);
+            st2.insert(cur);
+        }
+        auto it = st2.find(*st1.begin());
+
+        size_t before = heap_allocations;
+        order_statistic_tree<string> st3(std::move(st2)), st4;
+        st4 = std::move(st3);
+        size_t after = heap_allocations;
+
+        if (after != before || !st2.empty() || !st3.empty() || st2.begin() != st2.end()) failed.push_back({ 3, "wa" });
+        if (vector<string>(st1.begin(), st1.end()) != vector<string>(st4.begin(), st4.end()) || it != st4.begin()) failed.push_back({ 3, "wa" });
+
+        st2.insert("#");
+        st3 = st4;
+        st4 = std::move(st2);
+        if (st4.size() != 1 || *st4.begin() != "#" || st3.size() != st1.size() || !st2.empty()) failed.push_back({ 3, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 3, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void allocator_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        std::byte buffer[1 << 16];
+        std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+
+        set<int> st1;
+        order_statistic_tree<int, less<int>, std::pmr::polymorphic_allocator<int>> st2(&resource);
+
+        for (int i = 0; i < K2; i++) {
+            int q = ext_rand() % K2;
+            st1.insert(q);
+            st2.insert(q);
+        }
+
+        vector<int> vec1, vec2;
+        for (auto c : st1) vec1.push_back(c);
+        for (auto c : st2) vec2.push_back(c);
+
+        if (vec1 != vec2 || st2.get_allocator().resource() != &resource) failed.push_back({ 1, "wa" });
+    }
+    catch (std::bad_alloc&) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        std::byte buffer[1 << 19];
+        std::pmr::monotonic_buffer_resource resource(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+        using pmr_multiset = order_statistic_multiset<int, less<int>, std::pmr::polymorphic_allocator<int>>;
+
+        vector<int> keys(K2);
+        for (auto& q : keys) q = ext_rand() % K2;
+        multiset<int> st1(keys.begin(), keys.end());
+        st1.insert(keys.begin(), keys.end());
+        st1.insert(keys.begin(), keys.end());
+
+        // range construction, copies and set operations take their scratch memory from the buffer too
+        size_t before = heap_allocations;
+        pmr_multiset st2(keys.begin(), keys.end(), &resource), st3(&resource), st4(&resource), st5(&resource);
+        st3 = st2;
+        st5 = st2;
+        st4.insert_sorted(keys.begin(), keys.end());
+        st4.union_with(std::move(st3));
+        st4.union_with(std::move(st5));
+        size_t after = heap_allocations;
+
+        if (after != before || vector<int>(st1.begin(), st1.end()) != vector<int>(st4.begin(), st4.end())) failed.push_back({ 2, "wa" });
+    }
+    catch (std::bad_alloc&) {
+        failed.push_back({ 2, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void compact_tree_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        set<int> st1;
+        compact_order_statistic_tree<int> st2;
+
+        vector<int> vec1, vec2;
+        for (int i = 0; i < K2 * 10; i++) {
+            int q = ext_rand() % K2;
+            if (rand() % 3) {
+                vec1.push_back(st1.insert(q).second);
+                vec2.push_back(st2.insert(q));
+            } else {
+                vec1.push_back(st1.erase(q));
+                vec2.push_back(st2.erase(q));
+            }
+
+            q = ext_rand() % (K2 + 2) - 1;
+            vec1.push_back(st1.lower_bound(q) == st1.end() ? -10 : *st1.lower_bound(q));
+            vec2.push_back(st2.lower_bound(q) == st2.end() ? -10 : *st2.lower_bound(q));
+            vec1.push_back(st1.upper_bound(q) == st1.end() ? -10 : *st1.upper_bound(q));
+            vec2.push_back(st2.upper_bound(q) == st2.end() ? -10 : *st2.upper_bound(q));
+            vec1.push_back(st1.count(q));
+            vec2.push_back(st2.contains(q));
+        }
+
+        for (auto c : st1) vec1.push_back(c);
+        for (int i = 0; i < st2.size(); i++) vec2.push_back(*st2.statistic(i));
+        for (auto c : st2) vec2.push_back(c);
+        for (auto c : st1) vec1.push_back(c);
+
+        if (vec1 != vec2) failed.push_back({ 1, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        set<string> st1;
+        compact_order_statistic_tree<string> st2;
+
+        for (int i = 0; i < K2; i++) {
+            string ins;
+            for (int j = 0; j < rand() % 3 + 1; j++) {
+                ins.push_back(rand() % 26 + 'a');
+            }
+            st1.insert(ins);
+            st2.insert(ins);
+
+            ins.clear();
+            for (int j = 0; j < rand() % 3 + 1; j++) {
+                ins.push_back(rand() % 26 + 'a');
+            }
+            st1.erase(ins);
+            st2.erase(ins);
+        }
+
+        vector<string> vec1, vec2;
+        for (const auto& c : st1) vec1.push_back(c);
+        for (auto c : st2) vec2.push_back(c);
+
+        if (vec1 != vec2 || st2.find(vec1[0]) != st2.begin()) failed.push_back({ 2, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
 int main() {
     insert_test();
+    heterogeneous_lookup_test();
+    bulk_build_test();
     upper_and_lower_bound_test();
     contains_test();
     find_test();
     statistic_test();
+    order_of_key_test();
     erase_test();
     clear_and_empty_test();
     swap_test();
+    split_and_join_test();
+    set_operations_test();
+    multiset_test();
+    map_test();
+    augmentation_test();
+    weighted_statistic_test();
+    shift_range_test();
+    sequence_test();
+    node_handle_test();
+    batch_lookup_test();
+    sorted_batch_test();
+    frozen_tree_test();
+    copy_test();
+    allocator_test();
+    compact_tree_test();
 
     return 0;
 }
@@ -1,6 +1,9 @@
 #include <iostream>
 #include <set>
 #include <iomanip>
+#include <climits>
+#include <numeric>
+#include <algorithm>
 #include "order_statistic_tree.h"
 using namespace std;
 
@@ -261,11 +264,153 @@ void iterator_random_access_test() {
     result(__func__, failed.empty(), failed);
 }
 
+void iterator_arithmetic_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        multiset<int> st1;
+        order_statistic_multiset<int> st2;
+        for (int i = 0; i < K / 10; i++) {
+            int q = ext_rand() % (K / 100);
+            st1.insert(q);
+            st2.insert(q);
+        }
+
+        vector<int> vec(st1.begin(), st1.end());
+        int n = vec.size();
+        for (int i = 0; i < K / 10; i++) {
+            int q = (ext_rand() & INT_MAX) % n, q2 = (ext_rand() & INT_MAX) % n;
+            auto it = st2.begin() + q, it2 = st2.statistic(q2);
+            auto rit = st2.rbegin() + (n - 1 - q);
+
+            if (*it != vec[q] || it[q2 - q] != vec[q2] || *(it2 - (q2 - q)) != vec[q]) failed.push_back({ 1, "wa" });
+            if (it2 - it != q2 - q || (it < it2) != (q < q2) || (it >= it2) != (q >= q2)) failed.push_back({ 1, "wa" });
+            if (*rit != vec[q] || st2.rend() - rit != q + 1 || rit[q - q2] != vec[q2]) failed.push_back({ 1, "wa" });
+            if (it + (n - q) != st2.end() || st2.end() - (n - q) != it || (q2 - n) + st2.end() != it2) failed.push_back({ 1, "wa" });
+        }
+
+        if (distance(st2.begin(), st2.end()) != n || distance(st2.rbegin(), st2.rend()) != n) failed.push_back({ 1, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        set<int> st1;
+        order_statistic_tree<int> st2;
+        for (int i = 0; i < K / 10; i++) {
+            int q = ext_rand() % K;
+            st1.insert(q);
+            st2.insert(q);
+        }
+
+        for (int i = 0; i < K / 10; i++) {
+            int q = ext_rand() % K;
+            auto it = lower_bound(st2.begin(), st2.end(), q);
+            auto it2 = upper_bound(st2.rbegin(), st2.rend(), q, greater<int>());
+            if (it != st2.lower_bound(q) || (it2 == st2.rend() ? st1.lower_bound(q) != st1.begin() : *it2 != *prev(st1.lower_bound(q)))) failed.push_back({ 2, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
+void finger_search_test() {
+    vector<pair<int, string>> failed;
+    srand(1);
+
+    // test1
+    try {
+        multiset<int> st1;
+        order_statistic_multiset<int> st2;
+        auto it = st2.end();
+        for (int i = 0; i < K; i++) {
+            int q = i / 2 + ext_rand() % 20;
+            st1.insert(q);
+            it = st2.insert(it, q);
+            if (*it != q) failed.push_back({ 1, "wa" });
+        }
+
+        vector<int> vec(st1.begin(), st1.end()), vec2;
+        for (auto rit = st2.rbegin(); rit != st2.rend(); ++rit) vec2.push_back(*rit);
+        reverse(vec2.begin(), vec2.end());
+        if (vec != vec2 || st2.size() != vec.size()) failed.push_back({ 1, "wa" });
+
+        for (int i = 0; i < K / 10; i++) {
+            int q = (ext_rand() & INT_MAX) % vec.size();
+            if (*st2.statistic(q) != vec[q] || st2.order_of_key(vec[q]) != lower_bound(vec.begin(), vec.end(), vec[q]) - vec.begin()) failed.push_back({ 1, "wa" });
+        }
+    }
+    catch (int code) {
+        failed.push_back({ 1, "re" });
+    }
+
+    // test2
+    try {
+        set<int> st1;
+        order_statistic_tree<int> st2;
+        for (int i = 0; i < K / 10; i++) {
+            int q = ext_rand() % K;
+            auto hint = st2.empty() ? st2.end() : st2.statistic((ext_rand() & INT_MAX) % st2.size());
+            bool inserted = st1.insert(q).second;
+            size_t sz = st2.size();
+            auto it = st2.insert(hint, q);
+            if (*it != q || (st2.size() != sz) != inserted || it != st2.find(q)) failed.push_back({ 2, "wa" });
+
+            q = ext_rand() % K;
+            auto from = st2.statistic((ext_rand() & INT_MAX) % st2.size());
+            auto it2 = st1.lower_bound(q);
+            auto it3 = st2.lower_bound(from, q);
+            if ((it2 == st1.end()) != (it3 == st2.end()) || (it3 != st2.end() && *it2 != *it3)) failed.push_back({ 2, "wa" });
+        }
+
+        if (vector<int>(st1.begin(), st1.end()) != vector<int>(st2.begin(), st2.end())) failed.push_back({ 2, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 2, "re" });
+    }
+
+    // test3
+    try {
+        order_statistic_tree<long long, less<long long>, allocator<long long>, false, order_statistic_sum<long long>, true> st1;
+        set<long long> st2;
+        auto it = st1.end();
+        for (int i = 0; i < K / 10; i++) {
+            long long q = 3 * i;
+            if (i % 100 == 99) {
+                st1.shift_range(q / 2, q, 1);
+                set<long long> st3;
+                for (long long x : st2) st3.insert(x >= q / 2 && x <= q ? x + 1 : x);
+                st2.swap(st3);
+                it = st1.find(*st2.rbegin());
+            }
+            it = st1.insert(it, q);
+            st2.insert(q);
+        }
+
+        if (vector<long long>(st1.begin(), st1.end()) != vector<long long>(st2.begin(), st2.end())) failed.push_back({ 3, "wa" });
+        if (st1.aggregate() != accumulate(st2.begin(), st2.end(), 0LL)) failed.push_back({ 3, "wa" });
+    }
+    catch (int code) {
+        failed.push_back({ 3, "re" });
+    }
+
+    result(__func__, failed.empty(), failed);
+}
+
 int main() {
     iterating_with_increment_test();
     iterating_with_decrement_test();
     iterator_difference_test();
     iterator_random_access_test();
+    iterator_arithmetic_test();
+    finger_search_test();
 
     return 0;
 }